@@ -0,0 +1,114 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Times the batch Bezier evaluation against the scalar lookup table path for
+// a few handle positions that take different branches of the cubic solve.
+// Prints one JSON object per line.
+
+#include "plot-widget.h"
+#include "bezier-curve.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN_BENCHMARK_USEC 200000
+#define MIN_REPETITIONS 3
+
+typedef struct
+{
+    const char *name;
+    Point p1, p2;
+} HandleCase;
+
+static const HandleCase handle_cases[] = {
+    // The window's default curve, one real root
+    {"default", {0.4, 0.1}, {0.5, 0.5}},
+    // Three real roots for some x
+    {"s-curve", {1, 0}, {0, 1}},
+    // Cubic term cancels, quadratic solve
+    {"degenerate", {0.2, 0.3}, {0.2 + 1.0 / 3, 0.6}},
+};
+
+// 64 is what an apply samples, the larger sizes show the vectorized loops
+static const gsize batch_sizes[] = {64, 1024, 16384};
+
+static volatile double sink;
+
+static void print_result(const char *name, const HandleCase *handles, gsize n_points, double total_points, gint64 elapsed_usec)
+{
+    printf("{\"benchmark\": \"%s\", \"handles\": \"%s\", \"points\": %" G_GSIZE_FORMAT ", \"ns_per_point\": %.2f}\n",
+           name, handles->name, n_points, elapsed_usec * 1000.0 / total_points);
+    fflush(stdout);
+}
+
+static void run_batch(const BezierCurve *curve, const HandleCase *handles, const double *x_values, double *y_values, gsize n)
+{
+    guint repetitions = 0;
+    gint64 start_usec = g_get_monotonic_time(), elapsed_usec;
+    do
+    {
+        bezier_evaluate_batch(curve, x_values, y_values, n);
+        sink += y_values[n / 2];
+        repetitions++;
+        elapsed_usec = g_get_monotonic_time() - start_usec;
+    } while (repetitions < MIN_REPETITIONS || elapsed_usec < MIN_BENCHMARK_USEC);
+    print_result("bezier-batch", handles, n, (double)n * repetitions, elapsed_usec);
+}
+
+static void run_lut(const BezierCurve *curve, const HandleCase *handles, const double *x_values, double *y_values, gsize n)
+{
+    guint repetitions = 0;
+    gint64 start_usec = g_get_monotonic_time(), elapsed_usec;
+    do
+    {
+        for (gsize i = 0; i < n; i++)
+            y_values[i] = bezier_evaluate_lut(curve, x_values[i]);
+        sink += y_values[n / 2];
+        repetitions++;
+        elapsed_usec = g_get_monotonic_time() - start_usec;
+    } while (repetitions < MIN_REPETITIONS || elapsed_usec < MIN_BENCHMARK_USEC);
+    print_result("bezier-lut", handles, n, (double)n * repetitions, elapsed_usec);
+}
+
+int main(void)
+{
+    BezierCurve *curve = (BezierCurve *)bezier_curve_new();
+    gsize max_size = batch_sizes[G_N_ELEMENTS(batch_sizes) - 1];
+    double *x_values = g_new(double, max_size);
+    double *y_values = g_new(double, max_size);
+
+    for (gsize c = 0; c < G_N_ELEMENTS(handle_cases); c++)
+    {
+        curve->p1 = handle_cases[c].p1;
+        curve->p2 = handle_cases[c].p2;
+        bezier_update_lut(curve);
+        for (gsize s = 0; s < G_N_ELEMENTS(batch_sizes); s++)
+        {
+            gsize n = batch_sizes[s];
+            for (gsize i = 0; i < n; i++)
+                x_values[i] = i / (double)(n - 1);
+            run_batch(curve, &handle_cases[c], x_values, y_values, n);
+            run_lut(curve, &handle_cases[c], x_values, y_values, n);
+        }
+    }
+
+    g_free(x_values);
+    g_free(y_values);
+    g_free(curve);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,316 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Drives the speed pipeline headlessly with synthetic event streams: the
+// DeviceManager speed computation, the on_speed callback, the speed histogram
+// and quantiles behind the plot and, when a display is available, the whole
+// PlotWidget sample path. Prints one JSON object per line, benchmarks that
+// can't run print a "skipped" record.
+
+#include "device-manager.h"
+#include "plot-widget.h"
+#include "speed-histogram.h"
+#include "p2-quantile.h"
+#include "bezier-curve.c"
+
+#include <gtk/gtk.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FRAME_USEC 16667
+#define MIN_BENCHMARK_USEC 200000
+#define MIN_REPETITIONS 3
+
+#ifdef __GLIBC__
+// Count every allocation made by the process, GLib allocates through malloc
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_ulong allocation_count;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+static gboolean get_allocation_count(unsigned long *count)
+{
+    *count = atomic_load_explicit(&allocation_count, memory_order_relaxed);
+    return TRUE;
+}
+#else
+static gboolean get_allocation_count(unsigned long *count)
+{
+    *count = 0;
+    return FALSE;
+}
+#endif
+
+typedef enum
+{
+    STAGE_SPEED,
+    STAGE_HISTOGRAM,
+    STAGE_PLOT,
+} Stage;
+
+typedef struct
+{
+    PlotWidget *plot_widget;
+    double sink;
+    // What plot_widget_add_x_sample updates, for runs without a display
+    SpeedHistogram histogram;
+    P2Quantile speed_quantiles[PLOT_SPEED_QUANTILE_COUNT];
+} BenchmarkState;
+
+static double seconds = 10;
+static gint *rates = NULL;
+static gchar **rate_args = NULL;
+
+static GOptionEntry entries[] = {
+    {"seconds", 's', 0, G_OPTION_ARG_DOUBLE, &seconds, "Length of each synthetic stream in seconds of input", "SECONDS"},
+    {"rate", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &rate_args, "Event rate in Hz, may be repeated (default 125 to 8000)", "HZ"},
+    {NULL},
+};
+
+static const gint default_rates[] = {125, 500, 1000, 2000, 4000, 8000};
+
+// Deterministic hand movement: bursts of motion with a smooth speed profile,
+// a little sensor noise and +-5% report jitter.
+static EventTraceEvent *generate_events(EventTraceSource source, gint rate_hz, gsize *n_events)
+{
+    gsize n = (gsize)(seconds * rate_hz);
+    EventTraceEvent *events = g_new0(EventTraceEvent, n);
+    GRand *rng = g_rand_new_with_seed(rate_hz);
+    double interval_usec = 1000000.0 / rate_hz;
+    uint64_t time_usec = 1000000;
+    for (gsize i = 0; i < n; i++)
+    {
+        time_usec += (uint64_t)(interval_usec * g_rand_double_range(rng, 0.95, 1.05)) + 1;
+        // Units per ms, peaking at 8 twice a second
+        double speed = 4 * (1 - cos(time_usec * (2 * G_PI / 500000.0))) + g_rand_double_range(rng, 0, 0.2);
+        double distance = speed * interval_usec / 1000;
+        double angle = g_rand_double_range(rng, 0, 2 * G_PI);
+        events[i].time_usec = time_usec;
+        events[i].source = source;
+        if (source == EVENT_TRACE_SOURCE_MOTION)
+        {
+            events[i].dx = distance * cos(angle);
+            events[i].dy = distance * sin(angle);
+        }
+        else
+        {
+            events[i].scroll_y = distance;
+            if (source == EVENT_TRACE_SOURCE_WHEEL)
+                events[i].v120_y = distance * 120 / WHEEL_DEFAULT_CLICK_ANGLE;
+        }
+    }
+    g_rand_free(rng);
+    *n_events = n;
+    return events;
+}
+
+static void on_speed_sink(const SpeedSample *sample, gpointer user_data)
+{
+    BenchmarkState *state = user_data;
+    state->sink += sample->speed;
+}
+
+static void on_speed_histogram(const SpeedSample *sample, gpointer user_data)
+{
+    BenchmarkState *state = user_data;
+    speed_histogram_add(&state->histogram, sample->speed);
+    for (int i = 0; i < PLOT_SPEED_QUANTILE_COUNT; i++)
+        p2_quantile_add(&state->speed_quantiles[i], sample->speed);
+}
+
+static void on_speed_plot(const SpeedSample *sample, gpointer user_data)
+{
+    BenchmarkState *state = user_data;
+    plot_widget_add_x_sample(state->plot_widget, sample->speed);
+}
+
+// The widget isn't mapped so its tick callback never runs, do its work
+static void flush_frame(BenchmarkState *state)
+{
+    plot_widget_flush_frame_samples(state->plot_widget, g_get_monotonic_time());
+}
+
+static void run_stream(DeviceManager *manager, BenchmarkState *state, Stage stage, const EventTraceEvent *events, gsize n_events)
+{
+    if (stage != STAGE_PLOT)
+    {
+        device_manager_process_events(manager, events, n_events);
+        return;
+    }
+
+    // Feed a frame's worth of events at a time, as the main loop would
+    gsize start = 0;
+    while (start < n_events)
+    {
+        uint64_t frame_end_usec = events[start].time_usec + FRAME_USEC;
+        gsize end = start;
+        while (end < n_events && events[end].time_usec < frame_end_usec)
+            end++;
+        device_manager_process_events(manager, events + start, end - start);
+        flush_frame(state);
+        start = end;
+    }
+}
+
+static void run_benchmark(DeviceManager *manager, BenchmarkState *state, const char *name, Stage stage,
+                          EventTraceSource source, MovementType movement_type, gint rate_hz)
+{
+    gsize n_events;
+    EventTraceEvent *events = generate_events(source, rate_hz, &n_events);
+    device_manager_set_movement_type(manager, movement_type);
+    SpeedCallback callbacks[] = {
+        [STAGE_SPEED] = on_speed_sink,
+        [STAGE_HISTOGRAM] = on_speed_histogram,
+        [STAGE_PLOT] = on_speed_plot,
+    };
+    device_manager_set_speed_callback(manager, callbacks[stage], state);
+
+    // Warm up caches and any lazily allocated state
+    run_stream(manager, state, stage, events, n_events);
+
+    unsigned long allocations_before, allocations_after;
+    gboolean count_allocations = get_allocation_count(&allocations_before);
+    guint repetitions = 0;
+    gint64 start_usec = g_get_monotonic_time();
+    gint64 elapsed_usec;
+    do
+    {
+        run_stream(manager, state, stage, events, n_events);
+        repetitions++;
+        elapsed_usec = g_get_monotonic_time() - start_usec;
+    } while (repetitions < MIN_REPETITIONS || elapsed_usec < MIN_BENCHMARK_USEC);
+    get_allocation_count(&allocations_after);
+
+    double total_events = (double)n_events * repetitions;
+    g_autofree char *allocations = count_allocations
+                                       ? g_strdup_printf("%.4f", (allocations_after - allocations_before) / total_events)
+                                       : g_strdup("null");
+    printf("{\"benchmark\": \"%s\", \"rate_hz\": %d, \"events\": %.0f, \"ns_per_event\": %.2f, "
+           "\"events_per_second\": %.0f, \"allocations_per_event\": %s}\n",
+           name, rate_hz, total_events, elapsed_usec * 1000.0 / total_events,
+           total_events / (elapsed_usec / 1000000.0), allocations);
+    fflush(stdout);
+    g_free(events);
+}
+
+static void print_skipped(const char *name, gint rate_hz, const char *reason)
+{
+    printf("{\"benchmark\": \"%s\", \"rate_hz\": %d, \"skipped\": \"%s\"}\n", name, rate_hz, reason);
+    fflush(stdout);
+}
+
+static gboolean parse_rates(GError **error)
+{
+    if (!rate_args)
+        return TRUE;
+    guint n = g_strv_length(rate_args);
+    rates = g_new0(gint, n + 1);
+    for (guint i = 0; i < n; i++)
+    {
+        char *end;
+        gint64 rate = g_ascii_strtoll(rate_args[i], &end, 10);
+        if (*end != '\0' || rate <= 0 || rate > 100000)
+        {
+            g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Invalid rate \"%s\"", rate_args[i]);
+            return FALSE;
+        }
+        rates[i] = (gint)rate;
+    }
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new("- benchmark the event to plot pipeline");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error) || !parse_rates(&error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (seconds <= 0)
+    {
+        g_printerr("--seconds must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    DeviceManager *manager = device_manager_new_without_devices(NULL);
+    if (!manager)
+        return EXIT_FAILURE;
+
+    BenchmarkState state = {0};
+    speed_histogram_init(&state.histogram);
+    static const double percentiles[PLOT_SPEED_QUANTILE_COUNT] = {0.5, 0.95, 0.99, 0.999};
+    for (int i = 0; i < PLOT_SPEED_QUANTILE_COUNT; i++)
+        p2_quantile_init(&state.speed_quantiles[i], percentiles[i]);
+    gboolean have_display = gtk_init_check();
+    if (have_display)
+    {
+        state.plot_widget = PLOT_WIDGET(g_object_ref_sink(plot_widget_new()));
+        plot_widget_set_curve(state.plot_widget, bezier_curve_new());
+    }
+    else
+    {
+        g_printerr("No display, skipping the PlotWidget benchmarks\n");
+    }
+
+    const gint *rate = rates ? rates : default_rates;
+    gsize n_rates = rates ? g_strv_length(rate_args) : G_N_ELEMENTS(default_rates);
+    for (gsize i = 0; i < n_rates; i++)
+    {
+        run_benchmark(manager, &state, "motion-speed", STAGE_SPEED, EVENT_TRACE_SOURCE_MOTION, MOVEMENT_TYPE_MOTION, rate[i]);
+        run_benchmark(manager, &state, "scroll-speed", STAGE_SPEED, EVENT_TRACE_SOURCE_FINGER, MOVEMENT_TYPE_SCROLL, rate[i]);
+        run_benchmark(manager, &state, "wheel-speed", STAGE_SPEED, EVENT_TRACE_SOURCE_WHEEL, MOVEMENT_TYPE_SCROLL, rate[i]);
+        device_manager_set_speed_estimator(manager, SPEED_ESTIMATOR_LIBINPUT);
+        run_benchmark(manager, &state, "motion-tracker-speed", STAGE_SPEED, EVENT_TRACE_SOURCE_MOTION, MOVEMENT_TYPE_MOTION, rate[i]);
+        device_manager_set_speed_estimator(manager, SPEED_ESTIMATOR_TWO_EVENTS);
+        run_benchmark(manager, &state, "motion-histogram", STAGE_HISTOGRAM, EVENT_TRACE_SOURCE_MOTION, MOVEMENT_TYPE_MOTION, rate[i]);
+        if (have_display)
+            run_benchmark(manager, &state, "motion-plot", STAGE_PLOT, EVENT_TRACE_SOURCE_MOTION, MOVEMENT_TYPE_MOTION, rate[i]);
+        else
+            print_skipped("motion-plot", rate[i], "no display");
+    }
+
+    g_clear_object(&state.plot_widget);
+    device_manager_free(manager);
+    g_free(rates);
+    g_strfreev(rate_args);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "accel-property-mirror.h"
+#include <stdio.h>
+#include <string.h>
+
+void accel_property_get_name(int property_index, char *name, gsize size)
+{
+    if (property_index == ACCEL_PROPERTY_PROFILE)
+    {
+        g_strlcpy(name, "libinput Accel Profile Enabled", size);
+        return;
+    }
+    int movement_type = ACCEL_PROPERTY_MOVEMENT_TYPE(property_index);
+    const char *kind = property_index == ACCEL_PROPERTY_POINTS(movement_type) ? "Points" : "Step";
+    snprintf(name, size, "libinput Accel Custom %s %s", MOVEMENT_TYPE_STRINGS[movement_type], kind);
+}
+
+int accel_property_get_index(const guint32 atoms[ACCEL_PROPERTY_COUNT], guint32 property)
+{
+    // None until the driver registered the property
+    if (property == 0)
+        return -1;
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+    {
+        if (atoms[i] == property)
+            return i;
+    }
+    return -1;
+}
+
+AccelPropertyMirror *accel_property_mirror_new(void)
+{
+    AccelPropertyMirror *mirror = g_new0(AccelPropertyMirror, 1);
+    mirror->stale = ACCEL_PROPERTY_ALL;
+    return mirror;
+}
+
+void accel_property_mirror_property_changed(AccelPropertyMirror *mirror, int property_index)
+{
+    if (mirror->pending_writes[property_index] > 0)
+        mirror->pending_writes[property_index]--;
+    else
+        mirror->stale |= 1u << property_index;
+}
+
+static gboolean float_values_equal(const double *a, const double *b, int n)
+{
+    // The server stores 32 bit floats
+    for (int i = 0; i < n; i++)
+    {
+        if ((float)a[i] != (float)b[i])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+guint32 accel_property_mirror_get_changes(const AccelPropertyMirror *mirror, const AccelSettings *settings)
+{
+    const AccelSettings *current = &mirror->settings;
+    guint32 changes = 0;
+    if (memcmp(current->profile, settings->profile, sizeof(settings->profile)) != 0)
+        changes |= 1u << ACCEL_PROPERTY_PROFILE;
+    for (int i = 0; i < MOVEMENT_TYPE_COUNT; i++)
+    {
+        const CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[i];
+        const CustomAccelFunction *current_function = &current->custom_accel_functions[i];
+        if (custom_accel_function->npoints != current_function->npoints ||
+            !float_values_equal(custom_accel_function->points, current_function->points, custom_accel_function->npoints))
+            changes |= 1u << ACCEL_PROPERTY_POINTS(i);
+        if (!float_values_equal(&custom_accel_function->step, &current_function->step, 1))
+            changes |= 1u << ACCEL_PROPERTY_STEP(i);
+    }
+    return changes;
+}
+
+void accel_property_mirror_written(AccelPropertyMirror *mirror, const AccelSettings *settings, guint32 changes, gboolean success)
+{
+    if (!success)
+    {
+        memset(mirror->pending_writes, 0, sizeof(mirror->pending_writes));
+        mirror->stale = ACCEL_PROPERTY_ALL;
+        return;
+    }
+    if (!changes)
+        return;
+    mirror->settings = *settings;
+    // What the server actually stores
+    for (int i = 0; i < MOVEMENT_TYPE_COUNT; i++)
+    {
+        CustomAccelFunction *custom_accel_function = &mirror->settings.custom_accel_functions[i];
+        custom_accel_function->step = (float)custom_accel_function->step;
+        for (int j = 0; j < custom_accel_function->npoints; j++)
+            custom_accel_function->points[j] = (float)custom_accel_function->points[j];
+    }
+}
@@ -0,0 +1,58 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "device-manager.h"
+#include <glib.h>
+
+// The accel properties of one device: the profile, then points and step for
+// each movement type. Bit i of a property mask is property index i.
+#define ACCEL_PROPERTY_PROFILE 0
+#define ACCEL_PROPERTY_POINTS(movement_type) (1 + 2 * (movement_type))
+#define ACCEL_PROPERTY_STEP(movement_type) (2 + 2 * (movement_type))
+#define ACCEL_PROPERTY_COUNT (1 + 2 * MOVEMENT_TYPE_COUNT)
+#define ACCEL_PROPERTY_ALL ((1u << ACCEL_PROPERTY_COUNT) - 1)
+// Movement type of a points or step property
+#define ACCEL_PROPERTY_MOVEMENT_TYPE(property_index) (((property_index) - 1) / 2)
+
+// X property name of an accel property
+void accel_property_get_name(int property_index, char *name, gsize size);
+// Index of the property whose atom is property in atoms, indexed like the
+// properties, or -1. X atoms fit in 32 bits with Xlib and XCB alike.
+int accel_property_get_index(const guint32 atoms[ACCEL_PROPERTY_COUNT], guint32 property);
+
+// Last known server values of a device's accel properties. Property events
+// mark properties stale, they are fetched again only when read.
+typedef struct
+{
+    AccelSettings settings;
+    guint32 stale;
+    // Property events our own writes will generate, they don't make the
+    // mirror stale
+    guint8 pending_writes[ACCEL_PROPERTY_COUNT];
+} AccelPropertyMirror;
+
+AccelPropertyMirror *accel_property_mirror_new(void);
+void accel_property_mirror_property_changed(AccelPropertyMirror *mirror, int property_index);
+// Mask of the properties whose server values differ from settings
+guint32 accel_property_mirror_get_changes(const AccelPropertyMirror *mirror, const AccelSettings *settings);
+// After the properties in changes were written. Unless every write
+// succeeded it is unknown what the server has, so everything is fetched
+// again on the next read.
+void accel_property_mirror_written(AccelPropertyMirror *mirror, const AccelSettings *settings, guint32 changes, gboolean success);
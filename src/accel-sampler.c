@@ -0,0 +1,147 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "accel-sampler.h"
+#include <math.h>
+
+#define ACCEL_SAMPLING_NPOINTS 64
+#define ACCEL_SAMPLING_CANDIDATES 32
+// Speeds below this quantile are always interpolated, never extrapolated
+#define ACCEL_SAMPLING_COVERED_QUANTILE 0.99
+#define ACCEL_SAMPLING_MIN_RANGE_FRACTION 0.125
+// Uniform grid used for the max error on top of the histogram bins
+#define ACCEL_SAMPLING_ERROR_GRID 256
+#define ACCEL_SAMPLING_MAX_ERROR_SAMPLES (ACCEL_SAMPLING_ERROR_GRID + SPEED_HISTOGRAM_BIN_COUNT)
+
+typedef struct
+{
+    int n;
+    double speeds[ACCEL_SAMPLING_MAX_ERROR_SAMPLES];
+    double targets[ACCEL_SAMPLING_MAX_ERROR_SAMPLES];
+    double weights[ACCEL_SAMPLING_MAX_ERROR_SAMPLES];
+} ErrorSamples;
+
+static void sample_range(PlotWidget *plot_widget, double range, double x_axis_top_value, double y_axis_top_value,
+                         CustomAccelFunction *custom_accel_function)
+{
+    custom_accel_function->npoints = ACCEL_SAMPLING_NPOINTS;
+    custom_accel_function->step = range / (ACCEL_SAMPLING_NPOINTS - 1);
+    double x_values[ACCEL_SAMPLING_NPOINTS];
+    for (int i = 0; i < ACCEL_SAMPLING_NPOINTS; i++)
+        x_values[i] = i * custom_accel_function->step / x_axis_top_value;
+    plot_widget_get_y_values(plot_widget, x_values, custom_accel_function->points, ACCEL_SAMPLING_NPOINTS);
+    for (int i = 0; i < ACCEL_SAMPLING_NPOINTS; i++)
+        custom_accel_function->points[i] *= y_axis_top_value;
+}
+
+static void init_error_samples(ErrorSamples *samples, PlotWidget *plot_widget, const SpeedHistogram *histogram,
+                               double x_axis_top_value, double y_axis_top_value)
+{
+    samples->n = 0;
+    for (int i = 0; i < ACCEL_SAMPLING_ERROR_GRID; i++)
+    {
+        samples->speeds[samples->n] = (i + 0.5) * x_axis_top_value / ACCEL_SAMPLING_ERROR_GRID;
+        samples->weights[samples->n] = 0;
+        samples->n++;
+    }
+    for (int i = 0; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+    {
+        double speed = (speed_histogram_get_bin_start(i) + speed_histogram_get_bin_end(i)) / 2;
+        if (speed > x_axis_top_value)
+            break;
+        if (histogram->bins[i] == 0)
+            continue;
+        samples->speeds[samples->n] = speed;
+        samples->weights[samples->n] = histogram->bins[i];
+        samples->n++;
+    }
+
+    // The curve the user drew, evaluated once and shared by every candidate
+    for (int i = 0; i < samples->n; i++)
+        samples->targets[i] = samples->speeds[i] / x_axis_top_value;
+    plot_widget_get_y_values(plot_widget, samples->targets, samples->targets, samples->n);
+    for (int i = 0; i < samples->n; i++)
+        samples->targets[i] *= y_axis_top_value;
+}
+
+static void evaluate_error(const ErrorSamples *samples, const CustomAccelFunction *custom_accel_function,
+                           double *max_error, double *weighted_error)
+{
+    double error_sum = 0, weight_sum = 0;
+    *max_error = 0;
+    for (int i = 0; i < samples->n; i++)
+    {
+        double error = fabs(custom_accel_function_get_speed(custom_accel_function, samples->speeds[i]) - samples->targets[i]);
+        *max_error = fmax(*max_error, error);
+        error_sum += samples->weights[i] * error;
+        weight_sum += samples->weights[i];
+    }
+    *weighted_error = weight_sum > 0 ? error_sum / weight_sum : NAN;
+}
+
+static double histogram_quantile(const SpeedHistogram *histogram, double quantile)
+{
+    guint64 target = (guint64)ceil(quantile * histogram->total);
+    guint64 count = 0;
+    for (int i = 0; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+    {
+        count += histogram->bins[i];
+        if (count >= target)
+            return fmin(speed_histogram_get_bin_end(i), SPEED_HISTOGRAM_MAX_SPEED);
+    }
+    return SPEED_HISTOGRAM_MAX_SPEED;
+}
+
+void accel_sampler_sample(PlotWidget *plot_widget, const SpeedHistogram *histogram, AccelSamplingMode mode,
+                          CustomAccelFunction *custom_accel_function, AccelSamplingReport *report)
+{
+    double x_axis_top_value = plot_widget_get_x_axis_top_value(plot_widget);
+    double y_axis_top_value = plot_widget_get_y_axis_top_value(plot_widget);
+    ErrorSamples *samples = g_new(ErrorSamples, 1);
+    init_error_samples(samples, plot_widget, histogram, x_axis_top_value, y_axis_top_value);
+
+    // Uniform sampling over the whole axis is both the default and the
+    // baseline the weighted search has to beat
+    sample_range(plot_widget, x_axis_top_value, x_axis_top_value, y_axis_top_value, custom_accel_function);
+    report->range = x_axis_top_value;
+    evaluate_error(samples, custom_accel_function, &report->max_error, &report->weighted_error);
+
+    if (mode == ACCEL_SAMPLING_USAGE_WEIGHTED && histogram->total > 0)
+    {
+        double min_range = fmax(histogram_quantile(histogram, ACCEL_SAMPLING_COVERED_QUANTILE),
+                                x_axis_top_value * ACCEL_SAMPLING_MIN_RANGE_FRACTION);
+        min_range = fmin(min_range, x_axis_top_value);
+        for (int i = 0; i < ACCEL_SAMPLING_CANDIDATES - 1; i++)
+        {
+            double range = min_range + i * (x_axis_top_value - min_range) / (ACCEL_SAMPLING_CANDIDATES - 1);
+            CustomAccelFunction candidate = {0};
+            double max_error, weighted_error;
+            sample_range(plot_widget, range, x_axis_top_value, y_axis_top_value, &candidate);
+            evaluate_error(samples, &candidate, &max_error, &weighted_error);
+            if (weighted_error < report->weighted_error)
+            {
+                *custom_accel_function = candidate;
+                report->range = range;
+                report->max_error = max_error;
+                report->weighted_error = weighted_error;
+            }
+        }
+    }
+
+    g_free(samples);
+}
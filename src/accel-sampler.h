@@ -0,0 +1,42 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "device-manager.h"
+#include "plot-widget.h"
+#include "speed-histogram.h"
+
+typedef enum
+{
+    // 64 points from 0 to the x axis top value
+    ACCEL_SAMPLING_UNIFORM,
+    // Range chosen to minimise the interpolation error weighted by the
+    // recorded speed histogram
+    ACCEL_SAMPLING_USAGE_WEIGHTED,
+} AccelSamplingMode;
+
+typedef struct
+{
+    double range;          // speed covered by the points, libinput extrapolates beyond it
+    double max_error;      // in output speed units, over the whole x axis
+    double weighted_error; // mean error weighted by time spent at each speed, NAN without samples
+} AccelSamplingReport;
+
+void accel_sampler_sample(PlotWidget *plot_widget, const SpeedHistogram *histogram, AccelSamplingMode mode,
+                          CustomAccelFunction *custom_accel_function, AccelSamplingReport *report);
@@ -0,0 +1,66 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "accel-simulator.h"
+#include <math.h>
+
+void accel_simulator_init(AccelSimulator *simulator, const CustomAccelFunction *custom_accel_function)
+{
+    g_assert(custom_accel_function->npoints >= 2 && custom_accel_function->step > 0);
+    simulator->custom_accel_function = *custom_accel_function;
+    // The X driver hands libinput float32 properties
+    simulator->custom_accel_function.step = (float)custom_accel_function->step;
+    for (int i = 0; i < custom_accel_function->npoints; i++)
+        simulator->custom_accel_function.points[i] = (float)custom_accel_function->points[i];
+    accel_simulator_reset(simulator);
+}
+
+void accel_simulator_reset(AccelSimulator *simulator)
+{
+    simulator->last_time_usec = 0;
+    simulator->speed = 0;
+}
+
+static double get_accel_factor(const CustomAccelFunction *custom_accel_function, double speed_in)
+{
+    if (speed_in <= 0)
+    {
+        // Limit of speed_out / speed_in at 0, the slope of the first segment
+        return (custom_accel_function->points[1] - custom_accel_function->points[0]) / custom_accel_function->step;
+    }
+    return custom_accel_function_get_speed(custom_accel_function, speed_in) / speed_in;
+}
+
+void accel_simulator_filter(AccelSimulator *simulator, const SimulatorEvent *event, SimulatorEvent *accelerated)
+{
+    double dt_ms = custom_accel_get_dt_ms(&simulator->last_time_usec, event->time_usec);
+    // libinput would divide by zero, events without time passing keep the
+    // previous event's speed
+    if (dt_ms > 0)
+        simulator->speed = hypot(event->dx, event->dy) / dt_ms;
+    double factor = get_accel_factor(&simulator->custom_accel_function, simulator->speed);
+    accelerated->time_usec = event->time_usec;
+    accelerated->dx = event->dx * factor;
+    accelerated->dy = event->dy * factor;
+}
+
+void accel_simulator_filter_events(AccelSimulator *simulator, const SimulatorEvent *events, SimulatorEvent *accelerated, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        accel_simulator_filter(simulator, &events[i], &accelerated[i]);
+}
@@ -0,0 +1,44 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "custom-accel-function.h"
+
+typedef struct
+{
+    uint64_t time_usec;
+    double dx, dy; // unaccelerated, normalized to 1000 dpi like libinput's
+} SimulatorEvent;
+
+// Headless reimplementation of libinput's custom acceleration filter: speed
+// over the time since the previous event, piecewise linear interpolation over
+// the float32 points the X driver stores, and extrapolation past the last
+// point.
+typedef struct
+{
+    CustomAccelFunction custom_accel_function;
+    uint64_t last_time_usec;
+    // Of the last filtered event, in units/ms
+    double speed;
+} AccelSimulator;
+
+void accel_simulator_init(AccelSimulator *simulator, const CustomAccelFunction *custom_accel_function);
+void accel_simulator_reset(AccelSimulator *simulator);
+void accel_simulator_filter(AccelSimulator *simulator, const SimulatorEvent *event, SimulatorEvent *accelerated);
+void accel_simulator_filter_events(AccelSimulator *simulator, const SimulatorEvent *events, SimulatorEvent *accelerated, size_t n);
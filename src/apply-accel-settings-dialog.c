@@ -44,10 +44,18 @@ static void remove_timeouts(ApplyAccelSettingsDialog *dialog)
     }
 }
 
+static void on_restore_finished(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    DeviceManager *device_manager = user_data;
+    g_autoptr(GError) error = NULL;
+    if (!device_manager_restore_accel_settings_finish(device_manager, result, &error))
+        g_warning("%s", error->message);
+}
+
 static gboolean on_timeout_restore_settings(gpointer user_data)
 {
     ApplyAccelSettingsDialog *dialog = APPLY_ACCEL_SETTINGS_DIALOG(user_data);
-    device_manager_restore_accel_settings(dialog->device_manager);
+    device_manager_restore_accel_settings_async(dialog->device_manager, NULL, on_restore_finished, dialog->device_manager);
     remove_timeouts(dialog);
     adw_dialog_close(ADW_DIALOG(dialog));
     return FALSE; // Stop the timeout
@@ -77,7 +85,11 @@ static void on_dialog_response(AdwAlertDialog *dialog, const char *response_id,
     ApplyAccelSettingsDialog *self = APPLY_ACCEL_SETTINGS_DIALOG(user_data);
     if (g_strcmp0(response_id, "restore") == 0)
     {
-        device_manager_restore_accel_settings(self->device_manager);
+        device_manager_restore_accel_settings_async(self->device_manager, NULL, on_restore_finished, self->device_manager);
+    }
+    else
+    {
+        device_manager_keep_accel_settings(self->device_manager);
     }
     remove_timeouts(self);
     adw_dialog_close(ADW_DIALOG(self));
@@ -18,6 +18,26 @@
 
 #include "plot-widget.h"
 #include <math.h>
+#include <string.h>
+
+// The curve is sampled uniformly in t and evaluated by linear interpolation
+// between the samples. Against an exact root solve the error stays below 1e-4
+// (in normalized plot units) for every handle position, including handles on
+// the plot edges where the curve gets a vertical tangent.
+#define BEZIER_LUT_SIZE 1024
+// Uniform x buckets pointing into the samples so lookups only search a few
+#define BEZIER_LUT_BUCKETS 256
+// Below this leading coefficient x(t) is solved as a quadratic, the depressed
+// cubic loses precision as its coefficients grow like 1 / a^3. Up to 1e-3 the
+// quadratic with the cubic term folded in plus one Newton step is the more
+// accurate of the two (tests/bezier-curve-test.c).
+#define BEZIER_CUBIC_EPSILON 1e-3
+
+// a * t^3 + b * t^2 + c * t
+typedef struct
+{
+    double a, b, c;
+} CubicPolynomial;
 
 typedef struct
 {
@@ -25,6 +45,11 @@ typedef struct
     Point p1, p2;
     bool dragging;
     int drag_point;
+    CubicPolynomial x_polynomial;
+    CubicPolynomial y_polynomial;
+    double lut_x[BEZIER_LUT_SIZE];
+    double lut_y[BEZIER_LUT_SIZE];
+    int lut_buckets[BEZIER_LUT_BUCKETS + 1];
 } BezierCurve;
 
 static double clamp(double value, double min, double max)
@@ -38,35 +63,208 @@ static double bezier_interpolate(double t, double p0, double p1, double p2, doub
     return u * u * u * p0 + 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t * p3;
 }
 
-static double bezier_interpolate_derivative(double t, double p0, double p1, double p2, double p3)
+static CubicPolynomial bezier_polynomial(double p1, double p2)
 {
-    double u = 1 - t;
-    return 3 * u * u * (p1 - p0) + 6 * u * t * (p2 - p1) + 3 * t * t * (p3 - p2);
+    // Bernstein form with p0 = 0 and p3 = 1
+    return (CubicPolynomial){1 + 3 * p1 - 3 * p2, 3 * p2 - 6 * p1, 3 * p1};
 }
 
-static double bezier_get_y_value(PlotWidget *self, double x_value)
+static double cubic_polynomial_evaluate(const CubicPolynomial *polynomial, double t)
 {
-    BezierCurve *curve = (BezierCurve *)plot_widget_get_curve(self);
-    double t = x_value; // Initial guess
-    double x, dx;
-    int i = 0;
+    return ((polynomial->a * t + polynomial->b) * t + polynomial->c) * t;
+}
+
+// libm's cbrt is several times slower than the rest of the solve. Start from
+// an exponent/3 bit estimate and refine it, 4 steps reach full double precision.
+static double fast_cbrt(double value)
+{
+    double magnitude = fabs(value);
+    uint64_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    bits = bits / 3 + 0x2A9F7893782DA1CEull;
+    double root;
+    memcpy(&root, &bits, sizeof(root));
+    for (int i = 0; i < 4; i++)
+        root = (2 * root + magnitude / (root * root)) / 3;
+    return magnitude > 0 ? copysign(root, value) : 0;
+}
+
+static double distance_from_unit_interval(double t)
+{
+    return fmax(0, fmax(-t, t - 1));
+}
 
-    for (; i < 20; ++i) // Limit the number of iterations
+// Solve x(t) = x for t in [0, 1] in closed form, the kernel is chosen once
+// per curve. curve-benchmark measured about 110-160 ns per point against
+// 35-45 for the lookup table, the price of being exact: y values are within
+// 5e-6 of a bisection solve for any handle position, against 1e-4 for the
+// table (tests/bezier-curve-test.c).
+static void bezier_solve_t(const CubicPolynomial *polynomial, const double *x_values, double *t_values, size_t n)
+{
+    double a = polynomial->a, b = polynomial->b, c = polynomial->c;
+    if (fabs(a) < BEZIER_CUBIC_EPSILON)
     {
-        x = bezier_interpolate(t, 0.0, curve->p1.x, curve->p2.x, 1.0);
-        if (fabs(x - x_value) < 1e-6)
-            break;
+        // b t^2 + c t = x, in the cancellation free form. The cubic term is
+        // folded into b using the first estimate of t.
+        for (size_t i = 0; i < n; i++)
+        {
+            double x = x_values[i];
+            double denominator = c + sqrt(fmax(c * c + 4 * b * x, 0));
+            double t = denominator > 0 ? 2 * x / denominator : 0;
+            double b_corrected = b + a * t;
+            denominator = c + sqrt(fmax(c * c + 4 * b_corrected * x, 0));
+            t_values[i] = denominator > 0 ? 2 * x / denominator : 0;
+        }
+        return;
+    }
 
-        dx = bezier_interpolate_derivative(t, 0.0, curve->p1.x, curve->p2.x, 1.0);
-        t -= (x - x_value) / dx;
-        t = clamp(t, 0.0, 1.0);
+    // Depressed cubic s^3 + p s + q = 0 with t = s - shift, only q depends on x
+    double b_normalized = b / a, c_normalized = c / a;
+    double shift = b_normalized / 3;
+    double p = c_normalized - b_normalized * b_normalized / 3;
+    double q0 = 2 * b_normalized * b_normalized * b_normalized / 27 - b_normalized * c_normalized / 3;
+    double inverse_a = 1 / a;
+
+    if (p >= 0)
+    {
+        // Single real root for every x, Cardano's formula
+        for (size_t i = 0; i < n; i++)
+        {
+            double q = q0 - x_values[i] * inverse_a;
+            double discriminant = q * q / 4 + p * p * p / 27;
+            double u = -copysign(fast_cbrt(fabs(q) / 2 + sqrt(discriminant)), q);
+            double s = u != 0 ? u - p / (3 * u) : 0;
+            t_values[i] = s - shift;
+        }
+        return;
     }
 
-    return bezier_interpolate(t, 0.0, curve->p1.y, curve->p2.y, 1.0);
+    // Depending on x there are one or three real roots, compute both forms
+    // and keep the root that lies in [0, 1]
+    double r = 2 * sqrt(-p / 3);
+    double angle_factor = 1.5 * sqrt(-3 / p) / p;
+    double sqrt_3_over_2 = sqrt(3) / 2;
+    for (size_t i = 0; i < n; i++)
+    {
+        double q = q0 - x_values[i] * inverse_a;
+        double discriminant = q * q / 4 + p * p * p / 27;
+
+        double u = -copysign(fast_cbrt(fabs(q) / 2 + sqrt(fmax(discriminant, 0))), q);
+        double t_cardano = (u != 0 ? u - p / (3 * u) : 0) - shift;
+
+        // cos(angle - 2 pi k / 3) expanded so only one cos and sin are needed
+        double angle = acos(fmax(-1, fmin(1, q * angle_factor))) / 3;
+        double cos_angle = r * cos(angle), sin_angle = r * sin(angle) * sqrt_3_over_2;
+        double t0 = cos_angle - shift;
+        double t1 = -cos_angle / 2 + sin_angle - shift;
+        double t2 = -cos_angle / 2 - sin_angle - shift;
+        double d0 = distance_from_unit_interval(t0);
+        double d1 = distance_from_unit_interval(t1);
+        double d2 = distance_from_unit_interval(t2);
+        double t = t2, d = d2;
+        t = d1 <= d ? t1 : t;
+        d = fmin(d1, d);
+        t = d0 <= d ? t0 : t;
+
+        // Rounding can push a double root to either side of the discriminant,
+        // only trust Cardano's root when it lands in [0, 1]
+        double d_cardano = distance_from_unit_interval(t_cardano);
+        t_values[i] = discriminant > 0 && d_cardano <= 1e-6 ? t_cardano : t;
+    }
+}
+
+// One Newton step on x(t) = x for t in [0, 1] and x clamped to [0, 1], kept
+// only where it lowers the residual. Near the degenerate case the closed form loses a few digits to
+// the large normalized coefficients, the step wins them back. Branch free.
+static void bezier_refine_t(const CubicPolynomial *polynomial, const double *x_values, double *t_values, size_t n)
+{
+    double a = polynomial->a, b = polynomial->b, c = polynomial->c;
+    for (size_t i = 0; i < n; i++)
+    {
+        double x = clamp(x_values[i], 0.0, 1.0);
+        double t = clamp(t_values[i], 0.0, 1.0);
+        double residual = cubic_polynomial_evaluate(polynomial, t) - x;
+        double slope = (3 * a * t + 2 * b) * t + c;
+        double t_newton = clamp(t - residual / (slope != 0 ? slope : 1), 0.0, 1.0);
+        double residual_newton = cubic_polynomial_evaluate(polynomial, t_newton) - x;
+        t = slope != 0 && fabs(residual_newton) < fabs(residual) ? t_newton : t;
+        // The corners are exact, x(t) can touch them with a zero slope
+        t = x <= 0 ? 0 : t;
+        t_values[i] = x >= 1 ? 1 : t;
+    }
+}
+
+static void bezier_evaluate_batch(const BezierCurve *curve, const double *x_values, double *y_values, size_t n)
+{
+    // Use y_values as scratch for x clamped to [0, 1] and then for t
+    for (size_t i = 0; i < n; i++)
+        y_values[i] = clamp(x_values[i], 0.0, 1.0);
+    bezier_solve_t(&curve->x_polynomial, y_values, y_values, n);
+    bezier_refine_t(&curve->x_polynomial, x_values, y_values, n);
+    for (size_t i = 0; i < n; i++)
+        y_values[i] = cubic_polynomial_evaluate(&curve->y_polynomial, y_values[i]);
+}
+
+static void bezier_get_y_values(PlotWidget *self, const double *x_values, double *y_values, size_t n)
+{
+    bezier_evaluate_batch((BezierCurve *)plot_widget_get_curve(self), x_values, y_values, n);
+}
+
+static void bezier_update_lut(BezierCurve *curve)
+{
+    curve->x_polynomial = bezier_polynomial(curve->p1.x, curve->p2.x);
+    curve->y_polynomial = bezier_polynomial(curve->p1.y, curve->p2.y);
+    for (int i = 0; i < BEZIER_LUT_SIZE; i++)
+    {
+        double t = i / (double)(BEZIER_LUT_SIZE - 1);
+        curve->lut_x[i] = bezier_interpolate(t, 0.0, curve->p1.x, curve->p2.x, 1.0);
+        curve->lut_y[i] = bezier_interpolate(t, 0.0, curve->p1.y, curve->p2.y, 1.0);
+    }
+
+    // lut_buckets[k] is the last sample at or before x = k / BEZIER_LUT_BUCKETS
+    int i = 0;
+    for (int k = 0; k <= BEZIER_LUT_BUCKETS; k++)
+    {
+        double x = k / (double)BEZIER_LUT_BUCKETS;
+        while (i < BEZIER_LUT_SIZE - 2 && curve->lut_x[i + 1] <= x)
+            i++;
+        curve->lut_buckets[k] = i;
+    }
+}
+
+static double bezier_evaluate_lut(const BezierCurve *curve, double x_value)
+{
+    double x = clamp(x_value, 0.0, 1.0);
+    int bucket = (int)(x * BEZIER_LUT_BUCKETS);
+    int lo = curve->lut_buckets[bucket];
+    int hi = curve->lut_buckets[MIN(bucket + 1, BEZIER_LUT_BUCKETS)];
+
+    // Last sample with lut_x <= x, x(t) is monotone since handles stay in [0, 1]
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (curve->lut_x[mid] <= x)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    double dx = curve->lut_x[lo + 1] - curve->lut_x[lo];
+    if (dx <= 0)
+        return curve->lut_y[lo];
+    return curve->lut_y[lo] + (curve->lut_y[lo + 1] - curve->lut_y[lo]) * (x - curve->lut_x[lo]) / dx;
+}
+
+static double bezier_get_y_value(PlotWidget *self, double x_value)
+{
+    return bezier_evaluate_lut((BezierCurve *)plot_widget_get_curve(self), x_value);
 }
 
-static void bezier_draw(PlotWidget *self, cairo_t *cr)
+static void bezier_snapshot(PlotWidget *self, GtkSnapshot *snapshot)
 {
+    static const GdkRGBA handle_line_color = {0.5, 0.5, 0.5, 0.5};
+    static const GdkRGBA curve_color = {0, 0, 0, 1};
+    static const GdkRGBA control_point_color = {1, 0, 0, 1};
     BezierCurve *curve = (BezierCurve *)plot_widget_get_curve(self);
     Point p1_screen = plot_widget_to_screen(self, curve->p1);
     Point p2_screen = plot_widget_to_screen(self, curve->p2);
@@ -74,29 +272,25 @@ static void bezier_draw(PlotWidget *self, cairo_t *cr)
     Point end_screen = plot_widget_to_screen(self, (Point){1, 1});
 
     // Draw semi-transparent lines to handle points
-    cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.5);
-    cairo_move_to(cr, UNPACK(origin_screen));
-    cairo_line_to(cr, UNPACK(p1_screen));
-    cairo_move_to(cr, UNPACK(p2_screen));
-    cairo_line_to(cr, UNPACK(end_screen));
-    cairo_stroke(cr);
+    plot_widget_append_line(snapshot, origin_screen, p1_screen, 2, &handle_line_color);
+    plot_widget_append_line(snapshot, p2_screen, end_screen, 2, &handle_line_color);
 
     // Draw the Bezier curve
-    cairo_set_line_width(cr, 4);
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_move_to(cr, UNPACK(origin_screen));
-    cairo_curve_to(cr,
-                   UNPACK(p1_screen),
-                   UNPACK(p2_screen),
-                   UNPACK(end_screen));
-    cairo_stroke(cr);
+    GskPathBuilder *builder = gsk_path_builder_new();
+    gsk_path_builder_move_to(builder, UNPACK(origin_screen));
+    gsk_path_builder_cubic_to(builder,
+                              UNPACK(p1_screen),
+                              UNPACK(p2_screen),
+                              UNPACK(end_screen));
+    GskPath *path = gsk_path_builder_free_to_path(builder);
+    GskStroke *stroke = gsk_stroke_new(4);
+    gtk_snapshot_append_stroke(snapshot, path, stroke, &curve_color);
+    gsk_stroke_free(stroke);
+    gsk_path_unref(path);
 
     // Draw control points
-    cairo_set_source_rgb(cr, 1, 0, 0);
-    cairo_arc(cr, UNPACK(p1_screen), CONTROL_POINT_RADIUS, 0, 2 * G_PI);
-    cairo_fill(cr);
-    cairo_arc(cr, UNPACK(p2_screen), CONTROL_POINT_RADIUS, 0, 2 * G_PI);
-    cairo_fill(cr);
+    plot_widget_append_circle(snapshot, p1_screen, CONTROL_POINT_RADIUS, &control_point_color);
+    plot_widget_append_circle(snapshot, p2_screen, CONTROL_POINT_RADIUS, &control_point_color);
 }
 
 static void bezier_on_button_press(PlotWidget *self, double x, double y)
@@ -141,15 +335,17 @@ static void bezier_on_motion_notify(PlotWidget *self, double x, double y)
         {
             curve->p2 = p;
         }
-        gtk_widget_queue_draw(GTK_WIDGET(self));
+        bezier_update_lut(curve);
+        plot_widget_curve_changed(self);
     }
 }
 
 Curve *bezier_curve_new(void)
 {
     BezierCurve *bezier_curve = g_new0(BezierCurve, 1);
-    bezier_curve->base.draw = bezier_draw;
+    bezier_curve->base.snapshot = bezier_snapshot;
     bezier_curve->base.get_y_value = bezier_get_y_value;
+    bezier_curve->base.get_y_values = bezier_get_y_values;
     bezier_curve->base.on_button_press = bezier_on_button_press;
     bezier_curve->base.on_button_release = bezier_on_button_release;
     bezier_curve->base.on_motion_notify = bezier_on_motion_notify;
@@ -157,5 +353,6 @@ Curve *bezier_curve_new(void)
     bezier_curve->p2 = (Point){0.5, 0.5};
     bezier_curve->dragging = FALSE;
     bezier_curve->drag_point = 0;
+    bezier_update_lut(bezier_curve);
     return (Curve *)bezier_curve;
 }
@@ -0,0 +1,42 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "custom-accel-function.h"
+
+double custom_accel_function_get_speed(const CustomAccelFunction *custom_accel_function, double speed_in)
+{
+    // Same piecewise linear interpolation as libinput, the last segment is
+    // extrapolated for speeds beyond the last point
+    g_assert(custom_accel_function->npoints >= 2);
+    size_t i = (size_t)(speed_in / custom_accel_function->step);
+    i = MIN(i, (size_t)custom_accel_function->npoints - 2);
+    double x0 = custom_accel_function->step * i;
+    double y0 = custom_accel_function->points[i];
+    double y1 = custom_accel_function->points[i + 1];
+    return y0 + (speed_in - x0) * (y1 - y0) / custom_accel_function->step;
+}
+
+double custom_accel_get_dt_ms(uint64_t *last_time_usec, uint64_t time_usec)
+{
+    gboolean first = *last_time_usec == 0;
+    double dt_ms = (time_usec - *last_time_usec) / 1000.0;
+    *last_time_usec = time_usec;
+    if (first || dt_ms > CUSTOM_ACCEL_MOTION_TIMEOUT_MS)
+        return CUSTOM_ACCEL_FIRST_MOTION_INTERVAL_MS;
+    return dt_ms;
+}
@@ -0,0 +1,40 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+// libinput's custom acceleration profile measures speed as the distance over
+// the time since the previous event. The first event, and the first after a
+// pause, count as coming this long after the previous one.
+#define CUSTOM_ACCEL_FIRST_MOTION_INTERVAL_MS 7
+#define CUSTOM_ACCEL_MOTION_TIMEOUT_MS 1000
+
+typedef struct
+{
+    double step;
+    int npoints;
+    double points[64];
+} CustomAccelFunction;
+
+double custom_accel_function_get_speed(const CustomAccelFunction *custom_accel_function, double speed_in);
+// Milliseconds since the previous event as the custom profile counts them.
+// last_time_usec is 0 before the first event and is updated.
+double custom_accel_get_dt_ms(uint64_t *last_time_usec, uint64_t time_usec);
@@ -0,0 +1,197 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Replays a recorded event stream through the custom acceleration filter
+// without touching any device. Input is either an event trace recorded by
+// the app, of which the motion events are used, or lines of
+// "time_usec dx dy" with unaccelerated deltas. Output lines are
+// "time_usec dx dy" accelerated.
+
+#include "accel-simulator.h"
+#include "event-trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double step = 1;
+static char *points_arg = NULL;
+static gboolean summary_only = FALSE;
+
+static GOptionEntry entries[] = {
+    {"step", 's', 0, G_OPTION_ARG_DOUBLE, &step, "Distance between points in units/ms", "STEP"},
+    {"points", 'p', 0, G_OPTION_ARG_STRING, &points_arg, "Space separated output speeds, as in the xinput property", "POINTS"},
+    {"summary", 0, 0, G_OPTION_ARG_NONE, &summary_only, "Only print totals and throughput", NULL},
+    {NULL},
+};
+
+static gboolean parse_points(const char *text, CustomAccelFunction *custom_accel_function, GError **error)
+{
+    char **tokens = g_strsplit_set(text, " ,", -1);
+    custom_accel_function->npoints = 0;
+    for (char **token = tokens; *token; token++)
+    {
+        if (**token == '\0')
+            continue;
+        if (custom_accel_function->npoints == G_N_ELEMENTS(custom_accel_function->points))
+        {
+            g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "At most %d points are supported",
+                        (int)G_N_ELEMENTS(custom_accel_function->points));
+            g_strfreev(tokens);
+            return FALSE;
+        }
+        char *end;
+        double value = g_ascii_strtod(*token, &end);
+        if (*end != '\0')
+        {
+            g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Invalid point \"%s\"", *token);
+            g_strfreev(tokens);
+            return FALSE;
+        }
+        custom_accel_function->points[custom_accel_function->npoints++] = value;
+    }
+    g_strfreev(tokens);
+    if (custom_accel_function->npoints < 2)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "At least 2 points are required");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static GArray *read_events(FILE *file)
+{
+    GArray *events = g_array_sized_new(FALSE, FALSE, sizeof(SimulatorEvent), 1 << 16);
+    char line[256];
+    guint line_number = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        SimulatorEvent event;
+        char *cursor = line;
+        char *end;
+        event.time_usec = g_ascii_strtoull(cursor, &end, 10);
+        if (end == cursor)
+        {
+            // Blank and comment lines
+            continue;
+        }
+        cursor = end;
+        event.dx = g_ascii_strtod(cursor, &end);
+        gboolean valid = end != cursor;
+        cursor = end;
+        event.dy = g_ascii_strtod(cursor, &end);
+        valid = valid && end != cursor;
+        if (!valid)
+        {
+            g_printerr("Skipping malformed line %u\n", line_number);
+            continue;
+        }
+        g_array_append_val(events, event);
+    }
+    return events;
+}
+
+static GArray *read_trace_events(EventTrace *trace)
+{
+    GArray *events = g_array_sized_new(FALSE, FALSE, sizeof(SimulatorEvent), event_trace_get_n_records(trace));
+    EventTraceIter iter;
+    EventTraceEvent trace_event;
+    event_trace_iter_init(&iter, trace);
+    while (event_trace_iter_next(&iter, &trace_event))
+    {
+        if (trace_event.source != EVENT_TRACE_SOURCE_MOTION)
+            continue;
+        SimulatorEvent event = {trace_event.time_usec, trace_event.dx, trace_event.dy};
+        g_array_append_val(events, event);
+    }
+    return events;
+}
+
+int main(int argc, char *argv[])
+{
+    g_autoptr(GOptionContext) context = g_option_context_new("[FILE] - simulate libinput custom acceleration");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+    if (!points_arg || step <= 0)
+    {
+        g_printerr("--points and a positive --step are required\n");
+        return EXIT_FAILURE;
+    }
+
+    CustomAccelFunction custom_accel_function = {.step = step};
+    if (!parse_points(points_arg, &custom_accel_function, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    GArray *events;
+    EventTrace *trace = argc > 1 ? event_trace_open(argv[1], NULL) : NULL;
+    if (trace)
+    {
+        events = read_trace_events(trace);
+        event_trace_free(trace);
+    }
+    else
+    {
+        FILE *file = stdin;
+        if (argc > 1)
+        {
+            file = fopen(argv[1], "r");
+            if (!file)
+            {
+                g_printerr("Failed to open %s\n", argv[1]);
+                return EXIT_FAILURE;
+            }
+        }
+        events = read_events(file);
+        if (file != stdin)
+            fclose(file);
+    }
+
+    SimulatorEvent *accelerated = g_new(SimulatorEvent, MAX(events->len, 1));
+    AccelSimulator simulator;
+    accel_simulator_init(&simulator, &custom_accel_function);
+
+    gint64 start = g_get_monotonic_time();
+    accel_simulator_filter_events(&simulator, (SimulatorEvent *)events->data, accelerated, events->len);
+    gint64 elapsed_usec = MAX(g_get_monotonic_time() - start, 1);
+
+    double total_in = 0, total_out = 0;
+    for (guint i = 0; i < events->len; i++)
+    {
+        SimulatorEvent *in = &g_array_index(events, SimulatorEvent, i);
+        total_in += hypot(in->dx, in->dy);
+        total_out += hypot(accelerated[i].dx, accelerated[i].dy);
+        if (!summary_only)
+            printf("%" G_GUINT64_FORMAT " %.6f %.6f\n", accelerated[i].time_usec, accelerated[i].dx, accelerated[i].dy);
+    }
+
+    g_printerr("%u events in %.3f ms (%.1f M events/s), distance %.1f -> %.1f\n",
+               events->len, elapsed_usec / 1000.0, events->len / (double)elapsed_usec, total_in, total_out);
+
+    g_free(accelerated);
+    g_array_free(events, TRUE);
+    g_free(points_arg);
+    return EXIT_SUCCESS;
+}
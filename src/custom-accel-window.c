@@ -20,15 +20,27 @@
 #include "custom-accel-window.h"
 #include "device-manager.h"
 #include "plot-widget.h"
+#include "accel-sampler.h"
+#include "latency-stats.h"
 #include "bezier-curve.c"
+#include "spline-curve.c"
 #include "apply-accel-settings-dialog.h"
 #include "x11-accel-settings-manager.c"
+#include "xcb-accel-settings-manager.c"
 
 #include <adwaita.h>
 #include <gtk/gtk.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 
+// Items of curve_dropdown
+typedef enum
+{
+	CURVE_TYPE_BEZIER,
+	CURVE_TYPE_SPLINE,
+	CURVE_TYPE_COUNT
+} CurveType;
+
 struct _CustomAccelWindow
 {
 	AdwApplicationWindow parent_instance;
@@ -38,19 +50,86 @@ struct _CustomAccelWindow
 	GtkDropDown *device_dropdown;
 	GtkCheckButton *movement_type_button;
 	GtkCheckButton *scroll_movement_type_button;
+	GtkDropDown *scroll_source_dropdown;
+	GtkCheckButton *threaded_capture_button;
+	GtkDropDown *speed_estimator_dropdown;
+	GtkDropDown *x_axis_range_dropdown;
+	GtkDropDown *curve_dropdown;
+	GtkLabel *speed_quantiles_label;
 	GtkScale *y_axis_multiplier_scale;
+	GtkCheckButton *usage_weighted_sampling_button;
+	GtkCheckButton *live_preview_button;
 	GtkButton *apply_accel_button;
-	Curve *curve;
+	GtkLabel *sampling_error_label;
+	GtkLabel *device_stats_label;
+	GtkLabel *latency_label;
+	// Every curve type is kept so switching back doesn't lose its shape
+	Curve *curves[CURVE_TYPE_COUNT];
 	DeviceManager *device_manager;
+	GCancellable *apply_cancellable;
+	// Live preview: at most one apply in flight, changes made meanwhile
+	// are pushed once it finished
+	gboolean preview_in_flight;
+	gboolean preview_dirty;
+	gboolean preview_applied; // a push was queued since preview was turned on
+	gint64 last_preview_time;
+	guint preview_timeout_id;
+	guint stats_timeout_id;
+	LatencyStats latency_stats;
+	// Live samples waiting for the frame that first shows them
+	GArray *pending_latency_samples;
+	// Unmapped or minimized, samples are counted as skipped
+	gboolean frames_stopped;
 };
 
+// Push the curve at most ~25 times a second while previewing
+#define PREVIEW_INTERVAL_USEC (G_USEC_PER_SEC / 25)
+
+// Items of x_axis_range_dropdown
+typedef enum
+{
+	X_AXIS_RANGE_MAX,
+	X_AXIS_RANGE_P999,
+	X_AXIS_RANGE_P99,
+} XAxisRange;
+
+// Percentile ranges need enough samples to mean anything, and some room
+// above the percentile. The axis only shrinks once it is well past the
+// target and only grows once the percentile is well past the axis, so it
+// doesn't rescale the curve on every frame.
+#define X_AXIS_RANGE_MIN_SAMPLES 200
+#define X_AXIS_RANGE_HEADROOM 1.25
+#define X_AXIS_RANGE_SHRINK_THRESHOLD 0.7
+#define X_AXIS_RANGE_GROW_THRESHOLD 1.1
+
+// Bounds pending_latency_samples should frames stop without the window
+// being unmapped or minimized
+#define LATENCY_MAX_PENDING_SAMPLES 4096
+
 G_DEFINE_FINAL_TYPE(CustomAccelWindow, custom_accel_window, ADW_TYPE_APPLICATION_WINDOW)
 
+static void stop_live_preview(CustomAccelWindow *self);
+
+static void
+custom_accel_window_dispose(GObject *object)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(object);
+	g_clear_handle_id(&self->stats_timeout_id, g_source_remove);
+	stop_live_preview(self);
+	// Waits for queued settings I/O, including the restore above
+	g_clear_pointer(&self->device_manager, device_manager_free);
+	g_clear_pointer(&self->pending_latency_samples, g_array_unref);
+	G_OBJECT_CLASS(custom_accel_window_parent_class)->dispose(object);
+}
+
 static void
 custom_accel_window_class_init(CustomAccelWindowClass *klass)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
 	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
 
+	object_class->dispose = custom_accel_window_dispose;
+
 	// Register the PlotWidget type
 	g_type_ensure(PLOT_TYPE_WIDGET);
 
@@ -59,15 +138,30 @@ custom_accel_window_class_init(CustomAccelWindowClass *klass)
 	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, device_dropdown);
 	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, movement_type_button);
 	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, scroll_movement_type_button);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, scroll_source_dropdown);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, threaded_capture_button);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, speed_estimator_dropdown);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, x_axis_range_dropdown);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, curve_dropdown);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, speed_quantiles_label);
 	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, y_axis_multiplier_scale);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, usage_weighted_sampling_button);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, live_preview_button);
 	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, apply_accel_button);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, sampling_error_label);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, device_stats_label);
+	gtk_widget_class_bind_template_child(widget_class, CustomAccelWindow, latency_label);
 }
 
+static void schedule_live_preview(CustomAccelWindow *self);
+
 static void update_y_axis_top_value(CustomAccelWindow *self)
 {
 	double x_axis_top_value = plot_widget_get_x_axis_top_value(self->plot_widget);
 	double multiplier = gtk_range_get_value(GTK_RANGE(self->y_axis_multiplier_scale));
 	plot_widget_set_y_axis_top_value(self->plot_widget, x_axis_top_value * multiplier);
+	// The axes scale the curve, so the sampled function changed too
+	schedule_live_preview(self);
 }
 
 static void on_y_axis_multiplier_value_changed(GtkRange *range, gpointer user_data)
@@ -76,21 +170,115 @@ static void on_y_axis_multiplier_value_changed(GtkRange *range, gpointer user_da
 	update_y_axis_top_value(self);
 }
 
-static void on_speed(double speed_unaccel, gpointer user_data)
+// Samples that wait for frames that aren't coming would be charged to the
+// first frame after, their wait says nothing about rendering
+static void skip_pending_latency_samples(CustomAccelWindow *self)
+{
+	latency_stats_skip(&self->latency_stats, self->pending_latency_samples->len);
+	g_array_set_size(self->pending_latency_samples, 0);
+}
+
+static void update_frames_stopped(CustomAccelWindow *self)
+{
+	GdkSurface *surface = gtk_native_get_surface(GTK_NATIVE(self));
+	self->frames_stopped = !gtk_widget_get_mapped(GTK_WIDGET(self)) ||
+						   (surface && (gdk_toplevel_get_state(GDK_TOPLEVEL(surface)) & GDK_TOPLEVEL_STATE_MINIMIZED));
+	if (self->frames_stopped)
+		skip_pending_latency_samples(self);
+}
+
+static void on_surface_state_changed(GdkSurface *surface, GParamSpec *spec, gpointer user_data)
+{
+	update_frames_stopped(CUSTOM_ACCEL_WINDOW(user_data));
+}
+
+static void on_window_realize(GtkWidget *widget, gpointer user_data)
+{
+	g_signal_connect_object(gtk_native_get_surface(GTK_NATIVE(widget)), "notify::state",
+							G_CALLBACK(on_surface_state_changed), widget, 0);
+}
+
+static void on_window_map_changed(GtkWidget *widget, gpointer user_data)
+{
+	update_frames_stopped(CUSTOM_ACCEL_WINDOW(widget));
+}
+
+static void on_speed(const SpeedSample *sample, gpointer user_data)
 {
 	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
-	PlotWidget *plot_widget = self->plot_widget;
-	plot_widget_set_current_x_value(plot_widget, speed_unaccel);
-	if (speed_unaccel > plot_widget_get_x_axis_top_value(plot_widget))
+	// Replayed events carry trace times, they say nothing about this machine
+	if (sample->dequeue_time_usec)
 	{
-		plot_widget_set_x_axis_top_value(plot_widget, speed_unaccel);
-		update_y_axis_top_value(self);
+		latency_stats_add(&self->latency_stats, LATENCY_STAGE_INPUT, sample->dequeue_time_usec - sample->time_usec);
+		latency_stats_add(&self->latency_stats, LATENCY_STAGE_DELIVERY, sample->delivery_time_usec - sample->dequeue_time_usec);
+		if (self->pending_latency_samples->len >= LATENCY_MAX_PENDING_SAMPLES)
+			skip_pending_latency_samples(self);
+		if (self->frames_stopped)
+			latency_stats_skip(&self->latency_stats, 1);
+		else
+			g_array_append_val(self->pending_latency_samples, *sample);
 	}
+	// Coalesced by the plot and applied once per frame in on_frame_samples
+	plot_widget_add_x_sample(self->plot_widget, sample->speed);
+}
+
+static void update_x_axis_range(CustomAccelWindow *self, double frame_max)
+{
+	double x_axis_top_value = plot_widget_get_x_axis_top_value(self->plot_widget);
+	XAxisRange range = gtk_drop_down_get_selected(self->x_axis_range_dropdown);
+	double estimate = NAN;
+	if (range != X_AXIS_RANGE_MAX && plot_widget_get_histogram(self->plot_widget)->total >= X_AXIS_RANGE_MIN_SAMPLES)
+	{
+		PlotSpeedQuantile quantile = range == X_AXIS_RANGE_P999 ? PLOT_SPEED_QUANTILE_P999 : PLOT_SPEED_QUANTILE_P99;
+		estimate = plot_widget_get_speed_quantile(self->plot_widget, quantile);
+	}
+	double target = estimate * X_AXIS_RANGE_HEADROOM;
+
+	if (!(target > 0))
+	{
+		// Use the frame's peak so a short spike between frames still extends the axis
+		if (frame_max <= x_axis_top_value)
+			return;
+		target = frame_max;
+	}
+	else if (target >= x_axis_top_value * X_AXIS_RANGE_SHRINK_THRESHOLD &&
+			 estimate <= x_axis_top_value * X_AXIS_RANGE_GROW_THRESHOLD)
+	{
+		return;
+	}
+	plot_widget_set_x_axis_top_value(self->plot_widget, target);
+	update_y_axis_top_value(self);
+}
+
+static void on_frame_samples(PlotWidget *plot_widget, const PlotFrameSamples *samples, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	plot_widget_set_current_x_value(plot_widget, samples->last);
+	update_x_axis_range(self, samples->max);
+
+	// Every sample that arrived since the last frame is first shown by this one
+	for (guint i = 0; i < self->pending_latency_samples->len; i++)
+	{
+		const SpeedSample *sample = &g_array_index(self->pending_latency_samples, SpeedSample, i);
+		latency_stats_add(&self->latency_stats, LATENCY_STAGE_RENDER, samples->presentation_time_usec - (gint64)sample->delivery_time_usec);
+		latency_stats_add(&self->latency_stats, LATENCY_STAGE_TOTAL, samples->presentation_time_usec - (gint64)sample->time_usec);
+	}
+	g_array_set_size(self->pending_latency_samples, 0);
+}
+
+static void on_x_axis_range_changed(GtkDropDown *dropdown, GParamSpec *spec, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// Going back to the maximum waits for the next fast enough sample
+	update_x_axis_range(self, 0);
 }
 
 static void reset_plot_widget_axis_values(CustomAccelWindow *self)
 {
 	// reset top value and speed
+	plot_widget_discard_x_samples(self->plot_widget);
+	g_array_set_size(self->pending_latency_samples, 0);
+	plot_widget_clear_histogram(self->plot_widget);
 	plot_widget_set_x_axis_top_value(self->plot_widget, 1.0);
 	update_y_axis_top_value(self);
 	plot_widget_set_current_x_value(self->plot_widget, 0.0);
@@ -99,7 +287,13 @@ static void reset_plot_widget_axis_values(CustomAccelWindow *self)
 static void on_device_dropdown_changed(GtkDropDown *dropdown, GParamSpec *spec, gpointer user_data)
 {
 	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// Restore the previewed device, the preview doesn't follow the selection
+	gtk_check_button_set_active(self->live_preview_button, FALSE);
 	reset_plot_widget_axis_values(self);
+	latency_stats_init(&self->latency_stats);
+	// An apply that hasn't started yet was meant for the previous device
+	if (self->apply_cancellable)
+		g_cancellable_cancel(self->apply_cancellable);
 
 	int selected = gtk_drop_down_get_selected(dropdown);
 	if (selected == 0)
@@ -113,31 +307,152 @@ static void on_device_dropdown_changed(GtkDropDown *dropdown, GParamSpec *spec,
 	}
 }
 
-static void on_apply_accel_button_clicked(GtkButton *button, gpointer user_data)
+static void on_device_added(guint position, const char *device_name, gpointer user_data)
 {
 	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
-	// set up a custom accel formula for the currently selected device
-	double x_axis_top_value = plot_widget_get_x_axis_top_value(self->plot_widget);
-	double y_axis_top_value = plot_widget_get_y_axis_top_value(self->plot_widget);
-	CustomAccelFunction custom_accel_function = {0};
-	custom_accel_function.npoints = 64;
-	custom_accel_function.step = 1.0 / (custom_accel_function.npoints - 1);
+	GtkStringList *dropdown_model = GTK_STRING_LIST(gtk_drop_down_get_model(self->device_dropdown));
+	// The first dropdown entry is "no device"
+	gtk_string_list_splice(dropdown_model, position + 1, 0, (const char *const[]){device_name, NULL});
+}
+
+static void on_device_removed(guint position, const char *device_name, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	GtkStringList *dropdown_model = GTK_STRING_LIST(gtk_drop_down_get_model(self->device_dropdown));
+	// The device manager already detached it, don't let the dropdown move
+	// the selection to a neighbouring device
+	if (gtk_drop_down_get_selected(self->device_dropdown) == position + 1)
+		gtk_drop_down_set_selected(self->device_dropdown, 0);
+	gtk_string_list_remove(dropdown_model, position + 1);
+}
+
+static void update_speed_quantiles_label(CustomAccelWindow *self)
+{
+	double p50 = plot_widget_get_speed_quantile(self->plot_widget, PLOT_SPEED_QUANTILE_P50);
+	if (isnan(p50))
+	{
+		gtk_label_set_text(self->speed_quantiles_label, "");
+		return;
+	}
+	g_autofree char *text = g_strdup_printf("p50 %.2f, p95 %.2f, p99 %.2f u/ms", p50,
+											plot_widget_get_speed_quantile(self->plot_widget, PLOT_SPEED_QUANTILE_P95),
+											plot_widget_get_speed_quantile(self->plot_widget, PLOT_SPEED_QUANTILE_P99));
+	gtk_label_set_text(self->speed_quantiles_label, text);
+}
+
+// Items of scroll_source_dropdown, in order
+static const guint scroll_source_masks[] = {
+	SCROLL_SOURCES_ALL,
+	1u << EVENT_TRACE_SOURCE_WHEEL,
+	1u << EVENT_TRACE_SOURCE_FINGER,
+	1u << EVENT_TRACE_SOURCE_CONTINUOUS,
+};
+
+static guint get_plotted_sources(CustomAccelWindow *self)
+{
+	if (!gtk_check_button_get_active(self->scroll_movement_type_button))
+		return 1u << EVENT_TRACE_SOURCE_MOTION;
+	return scroll_source_masks[gtk_drop_down_get_selected(self->scroll_source_dropdown)];
+}
+
+static void update_device_stats_label(CustomAccelWindow *self)
+{
+	// Every device is captured, list them all for the plotted sources
+	guint sources = get_plotted_sources(self);
+	g_autoptr(GtkStringList) device_names = device_manager_get_device_names(self->device_manager);
+	g_autoptr(GtkStringList) device_nodes = device_manager_get_device_nodes(self->device_manager);
+	g_autoptr(GString) text = g_string_new(NULL);
+	for (guint i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(device_names)); i++)
+	{
+		const char *device_name = gtk_string_list_get_string(device_names, i);
+		DeviceStats stats;
+		if (!device_manager_get_device_stats(self->device_manager, gtk_string_list_get_string(device_nodes, i), &stats))
+			continue;
+		guint64 n_events = 0;
+		double speed_sum = 0, max_speed = 0;
+		for (int source = 0; source < EVENT_TRACE_SOURCE_COUNT; source++)
+		{
+			if (!(sources & (1u << source)))
+				continue;
+			n_events += stats.n_events[source];
+			speed_sum += stats.speed_sum[source];
+			max_speed = MAX(max_speed, stats.max_speed[source]);
+		}
+		if (n_events == 0)
+			continue;
+		g_string_append_printf(text, "%s%s: %" G_GUINT64_FORMAT " events, mean %.2f u/ms, peak %.2f u/ms",
+							   text->len ? "\n" : "", device_name, n_events, speed_sum / n_events, max_speed);
+	}
+	guint dropped = device_manager_get_dropped_samples(self->device_manager);
+	if (dropped > 0)
+		g_string_append_printf(text, "%s%u samples dropped, the plot fell behind the capture thread",
+							   text->len ? "\n" : "", dropped);
+	gtk_label_set_text(self->device_stats_label, text->str);
+}
 
-	for (int i = 0; i < custom_accel_function.npoints; i++)
+static void update_latency_label(CustomAccelWindow *self)
+{
+	g_autoptr(GString) text = g_string_new(NULL);
+	for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
 	{
-		custom_accel_function.points[i] = self->curve->get_y_value(self->plot_widget, i * custom_accel_function.step) * y_axis_top_value;
+		if (latency_stats_get_count(&self->latency_stats, stage) == 0)
+			continue;
+		g_string_append_printf(text, "%s%-8s p50 %6.2f  p99 %6.2f  max %6.2f ms", text->len ? "\n" : "",
+							   LATENCY_STAGE_NAMES[stage],
+							   latency_stats_get_p50(&self->latency_stats, stage) / 1000,
+							   latency_stats_get_p99(&self->latency_stats, stage) / 1000,
+							   latency_stats_get_max(&self->latency_stats, stage) / 1000);
 	}
-	custom_accel_function.step *= x_axis_top_value;
+	if (self->latency_stats.skipped > 0)
+		g_string_append_printf(text, "%s%" G_GUINT64_FORMAT " samples skipped while hidden", text->len ? "\n" : "",
+							   self->latency_stats.skipped);
+	gtk_label_set_text(self->latency_label, text->str);
+}
 
-	if (!device_manager_set_custom_accel_function(self->device_manager, &custom_accel_function))
+static gboolean update_stats_labels(gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// Once a second is plenty for reading, and keeps the labels from
+	// relayouting every frame
+	update_speed_quantiles_label(self);
+	update_device_stats_label(self);
+	update_latency_label(self);
+	return G_SOURCE_CONTINUE;
+}
+
+static void update_sampling_error_label(CustomAccelWindow *self, const AccelSamplingReport *report)
+{
+	g_autofree char *weighted_error = isnan(report->weighted_error)
+										  ? g_strdup("-")
+										  : g_strdup_printf("%.3f", report->weighted_error);
+	g_autofree char *text = g_strdup_printf("Sampled up to %.2f u/ms\nMax error: %.3f px/ms\nWeighted error: %s px/ms",
+											report->range, report->max_error, weighted_error);
+	gtk_label_set_text(self->sampling_error_label, text);
+}
+
+static void show_error(CustomAccelWindow *self, const char *heading, GError *error)
+{
+	AdwDialog *dialog = adw_alert_dialog_new(heading, error ? error->message : NULL);
+	adw_alert_dialog_add_responses(ADW_ALERT_DIALOG(dialog),
+								   "cancel", "_Cancel",
+								   NULL);
+	adw_alert_dialog_set_default_response(ADW_ALERT_DIALOG(dialog), "cancel");
+	adw_alert_dialog_set_close_response(ADW_ALERT_DIALOG(dialog), "cancel");
+	adw_dialog_present(dialog, GTK_WIDGET(self));
+}
+
+static void on_apply_finished(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	g_autoptr(CustomAccelWindow) self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GError) error = NULL;
+	g_clear_object(&self->apply_cancellable);
+	if (!self->device_manager)
+		return;
+	gtk_widget_set_sensitive(GTK_WIDGET(self->apply_accel_button), !gtk_check_button_get_active(self->live_preview_button));
+	if (!device_manager_apply_custom_accel_function_finish(self->device_manager, result, &error))
 	{
-		AdwDialog *dialog = adw_alert_dialog_new("Failed to set custom acceleration function for the selected device", NULL);
-		adw_alert_dialog_add_responses(ADW_ALERT_DIALOG(dialog),
-									   "cancel", "_Cancel",
-									   NULL);
-		adw_alert_dialog_set_default_response(ADW_ALERT_DIALOG(dialog), "cancel");
-		adw_alert_dialog_set_close_response(ADW_ALERT_DIALOG(dialog), "cancel");
-		adw_dialog_present(dialog, GTK_WIDGET(self));
+		if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			show_error(self, "Failed to set custom acceleration function for the selected device", error);
 		return;
 	}
 
@@ -145,6 +460,133 @@ static void on_apply_accel_button_clicked(GtkButton *button, gpointer user_data)
 	adw_dialog_present(ADW_DIALOG(dialog), GTK_WIDGET(self));
 }
 
+static void sample_custom_accel_function(CustomAccelWindow *self, CustomAccelFunction *custom_accel_function)
+{
+	AccelSamplingMode mode = gtk_check_button_get_active(self->usage_weighted_sampling_button)
+								 ? ACCEL_SAMPLING_USAGE_WEIGHTED
+								 : ACCEL_SAMPLING_UNIFORM;
+	AccelSamplingReport report;
+	accel_sampler_sample(self->plot_widget, plot_widget_get_histogram(self->plot_widget), mode,
+						 custom_accel_function, &report);
+	update_sampling_error_label(self, &report);
+}
+
+static void on_apply_accel_button_clicked(GtkButton *button, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// set up a custom accel formula for the currently selected device
+	CustomAccelFunction custom_accel_function = {0};
+	sample_custom_accel_function(self, &custom_accel_function);
+
+	// One apply at a time, the settings I/O runs off the main thread
+	gtk_widget_set_sensitive(GTK_WIDGET(self->apply_accel_button), FALSE);
+	self->apply_cancellable = g_cancellable_new();
+	device_manager_apply_custom_accel_function_async(self->device_manager, &custom_accel_function, self->apply_cancellable,
+													 on_apply_finished, g_object_ref(self));
+}
+
+static void push_live_preview(CustomAccelWindow *self);
+
+static void on_live_preview_applied(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	g_autoptr(CustomAccelWindow) self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GError) error = NULL;
+	self->preview_in_flight = FALSE;
+	if (!self->device_manager)
+		return;
+	if (!device_manager_apply_custom_accel_function_finish(self->device_manager, result, &error))
+	{
+		if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			// Don't keep hammering a device that refuses the settings
+			gtk_check_button_set_active(self->live_preview_button, FALSE);
+			show_error(self, "Failed to preview custom acceleration function for the selected device", error);
+		}
+		return;
+	}
+	if (self->preview_dirty && gtk_check_button_get_active(self->live_preview_button))
+		schedule_live_preview(self);
+}
+
+static gboolean on_live_preview_timeout(gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	self->preview_timeout_id = 0;
+	push_live_preview(self);
+	return G_SOURCE_REMOVE;
+}
+
+static void push_live_preview(CustomAccelWindow *self)
+{
+	CustomAccelFunction custom_accel_function = {0};
+	sample_custom_accel_function(self, &custom_accel_function);
+	self->preview_dirty = FALSE;
+	self->preview_in_flight = TRUE;
+	// Set right away, a restore queued meanwhile runs after this apply
+	self->preview_applied = TRUE;
+	self->last_preview_time = g_get_monotonic_time();
+	device_manager_preview_custom_accel_function_async(self->device_manager, &custom_accel_function, NULL,
+													   on_live_preview_applied, g_object_ref(self));
+}
+
+static void schedule_live_preview(CustomAccelWindow *self)
+{
+	if (!self->device_manager || !gtk_check_button_get_active(self->live_preview_button))
+		return;
+	self->preview_dirty = TRUE;
+	// Picked up when the pending push finishes or the timer fires
+	if (self->preview_in_flight || self->preview_timeout_id)
+		return;
+
+	gint64 wait = self->last_preview_time + PREVIEW_INTERVAL_USEC - g_get_monotonic_time();
+	if (wait <= 0)
+		push_live_preview(self);
+	else
+		self->preview_timeout_id = g_timeout_add(wait / 1000 + 1, on_live_preview_timeout, self);
+}
+
+static void on_live_preview_restored(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	g_autoptr(GError) error = NULL;
+	if (!device_manager_restore_accel_settings_finish((DeviceManager *)user_data, result, &error))
+		g_warning("Failed to restore accel settings after live preview: %s", error->message);
+}
+
+static void stop_live_preview(CustomAccelWindow *self)
+{
+	g_clear_handle_id(&self->preview_timeout_id, g_source_remove);
+	self->preview_dirty = FALSE;
+	// Queued behind a push still in flight, so the original settings win
+	if (self->preview_applied && self->device_manager)
+		device_manager_restore_accel_settings_async(self->device_manager, NULL, on_live_preview_restored, self->device_manager);
+	self->preview_applied = FALSE;
+}
+
+static void on_live_preview_toggled(GtkCheckButton *button, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	gboolean active = gtk_check_button_get_active(button);
+	// Apply would save the previewed settings as the ones to restore to
+	gtk_widget_set_sensitive(GTK_WIDGET(self->apply_accel_button), !active && !self->apply_cancellable);
+	if (active)
+		schedule_live_preview(self);
+	else
+		stop_live_preview(self);
+}
+
+static void on_curve_changed(PlotWidget *plot_widget, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	schedule_live_preview(self);
+}
+
+static void on_curve_type_changed(GtkDropDown *dropdown, GParamSpec *spec, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	plot_widget_set_curve(self->plot_widget, self->curves[gtk_drop_down_get_selected(dropdown)]);
+	schedule_live_preview(self);
+}
+
 static void custom_accel_window_set_movement_type(CustomAccelWindow *self, MovementType movement_type)
 {
 	device_manager_set_movement_type(self->device_manager, movement_type);
@@ -183,15 +625,143 @@ static void on_scroll_movement_type_toggled(GtkCheckButton *button, gpointer use
 	}
 }
 
+static void on_threaded_capture_toggled(GtkCheckButton *button, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	device_manager_set_threaded_capture(self->device_manager, gtk_check_button_get_active(button));
+}
+
+static void on_speed_estimator_changed(GtkDropDown *dropdown, GParamSpec *spec, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// Speeds measured one way don't belong on an axis scaled by the other
+	reset_plot_widget_axis_values(self);
+	// Dropdown items are in SpeedEstimator order
+	device_manager_set_speed_estimator(self->device_manager, gtk_drop_down_get_selected(dropdown));
+}
+
+static void on_scroll_source_changed(GtkDropDown *dropdown, GParamSpec *spec, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	// Sources have unrelated speed ranges, start the axes over
+	reset_plot_widget_axis_values(self);
+	device_manager_set_scroll_sources(self->device_manager, scroll_source_masks[gtk_drop_down_get_selected(dropdown)]);
+}
+
+static void update_recording_actions(CustomAccelWindow *self)
+{
+	gboolean recording = device_manager_is_recording(self->device_manager);
+	GAction *action = g_action_map_lookup_action(G_ACTION_MAP(self), "record-events");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(action), !recording);
+	action = g_action_map_lookup_action(G_ACTION_MAP(self), "stop-recording");
+	g_simple_action_set_enabled(G_SIMPLE_ACTION(action), recording);
+}
+
+static void on_record_file_selected(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GFile) file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file)
+		return;
+	g_autofree char *path = g_file_get_path(file);
+	g_autoptr(GError) error = NULL;
+	if (!device_manager_start_recording(self->device_manager, path, &error))
+		show_error(self, "Failed to start recording", error);
+	update_recording_actions(self);
+}
+
+static void record_events_action(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GtkFileDialog) dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Record Events");
+	gtk_file_dialog_set_initial_name(dialog, "events.trace");
+	gtk_file_dialog_save(dialog, GTK_WINDOW(self), NULL, on_record_file_selected, self);
+}
+
+static void stop_recording_action(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GError) error = NULL;
+	if (!device_manager_stop_recording(self->device_manager, &error))
+		show_error(self, "Failed to save the recording", error);
+	update_recording_actions(self);
+}
+
+static void on_replay_file_selected(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GFile) file = gtk_file_dialog_open_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file)
+		return;
+	g_autofree char *path = g_file_get_path(file);
+	g_autoptr(GError) error = NULL;
+	reset_plot_widget_axis_values(self);
+	if (!device_manager_replay_trace(self->device_manager, path, TRUE, &error))
+		show_error(self, "Failed to replay events", error);
+}
+
+static void replay_events_action(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GtkFileDialog) dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Replay Events");
+	gtk_file_dialog_open(dialog, GTK_WINDOW(self), NULL, on_replay_file_selected, self);
+}
+
+static void on_latency_report_file_selected(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GFile) file = gtk_file_dialog_save_finish(GTK_FILE_DIALOG(source), result, NULL);
+	if (!file)
+		return;
+	g_autofree char *path = g_file_get_path(file);
+	g_autofree char *json = latency_stats_to_json(&self->latency_stats);
+	g_autoptr(GError) error = NULL;
+	if (!g_file_set_contents(path, json, -1, &error))
+		show_error(self, "Failed to save the latency report", error);
+}
+
+static void save_latency_report_action(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	CustomAccelWindow *self = CUSTOM_ACCEL_WINDOW(user_data);
+	g_autoptr(GtkFileDialog) dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Save Latency Report");
+	gtk_file_dialog_set_initial_name(dialog, "latency.json");
+	gtk_file_dialog_save(dialog, GTK_WINDOW(self), NULL, on_latency_report_file_selected, self);
+}
+
+static const GActionEntry win_actions[] = {
+	{"record-events", record_events_action},
+	{"stop-recording", stop_recording_action},
+	{"replay-events", replay_events_action},
+	{"save-latency-report", save_latency_report_action},
+};
+
 static void
 custom_accel_window_init(CustomAccelWindow *self)
 {
 	gtk_widget_init_template(GTK_WIDGET(self));
-	self->curve = bezier_curve_new();
-	plot_widget_set_curve(self->plot_widget, self->curve);
+	latency_stats_init(&self->latency_stats);
+	self->pending_latency_samples = g_array_new(FALSE, FALSE, sizeof(SpeedSample));
+	self->frames_stopped = TRUE;
+	g_signal_connect(self, "realize", G_CALLBACK(on_window_realize), NULL);
+	g_signal_connect(self, "map", G_CALLBACK(on_window_map_changed), NULL);
+	g_signal_connect(self, "unmap", G_CALLBACK(on_window_map_changed), NULL);
+	self->curves[CURVE_TYPE_BEZIER] = bezier_curve_new();
+	self->curves[CURVE_TYPE_SPLINE] = spline_curve_new();
+	plot_widget_set_curve(self->plot_widget, self->curves[CURVE_TYPE_BEZIER]);
+	g_signal_connect(self->curve_dropdown, "notify::selected", G_CALLBACK(on_curve_type_changed), self);
+	plot_widget_set_frame_samples_callback(self->plot_widget, on_frame_samples, self);
+	plot_widget_set_curve_changed_callback(self->plot_widget, on_curve_changed, self);
 
 	// Initialize device manager
-	AccelSettingsManager *accel_settings_manager = x11_accel_settings_manager_new();
+	// The XCB backend pipelines its requests, keep Xlib as a fallback
+	AccelSettingsManager *accel_settings_manager = NULL;
+	if (g_strcmp0(g_getenv("CUSTOM_ACCEL_X11_BACKEND"), "xlib") != 0)
+		accel_settings_manager = xcb_accel_settings_manager_new();
+	if (!accel_settings_manager)
+		accel_settings_manager = x11_accel_settings_manager_new();
 	self->device_manager = device_manager_new(accel_settings_manager);
 	if (!self->device_manager)
 	{
@@ -214,11 +784,23 @@ custom_accel_window_init(CustomAccelWindow *self)
 	}
 
 	device_manager_set_speed_callback(self->device_manager, on_speed, self);
+	device_manager_set_device_callbacks(self->device_manager, on_device_added, on_device_removed, self);
+	g_action_map_add_action_entries(G_ACTION_MAP(self), win_actions, G_N_ELEMENTS(win_actions), self);
+	update_recording_actions(self);
 	custom_accel_window_set_movement_type(self, MOVEMENT_TYPE_MOTION);
+	// What the custom curve is actually fed with
+	gtk_drop_down_set_selected(self->speed_estimator_dropdown, SPEED_ESTIMATOR_TWO_EVENTS);
+	device_manager_set_speed_estimator(self->device_manager, SPEED_ESTIMATOR_TWO_EVENTS);
 
 	g_signal_connect(self->device_dropdown, "notify::selected", G_CALLBACK(on_device_dropdown_changed), self);
 	g_signal_connect(self->movement_type_button, "toggled", G_CALLBACK(on_movement_type_toggled), self);
 	g_signal_connect(self->scroll_movement_type_button, "toggled", G_CALLBACK(on_scroll_movement_type_toggled), self);
+	g_signal_connect(self->scroll_source_dropdown, "notify::selected", G_CALLBACK(on_scroll_source_changed), self);
+	g_signal_connect(self->threaded_capture_button, "toggled", G_CALLBACK(on_threaded_capture_toggled), self);
+	g_signal_connect(self->speed_estimator_dropdown, "notify::selected", G_CALLBACK(on_speed_estimator_changed), self);
+	g_signal_connect(self->x_axis_range_dropdown, "notify::selected", G_CALLBACK(on_x_axis_range_changed), self);
 	g_signal_connect(self->y_axis_multiplier_scale, "value-changed", G_CALLBACK(on_y_axis_multiplier_value_changed), self);
 	g_signal_connect(self->apply_accel_button, "clicked", G_CALLBACK(on_apply_accel_button_clicked), self);
+	g_signal_connect(self->live_preview_button, "toggled", G_CALLBACK(on_live_preview_toggled), self);
+	self->stats_timeout_id = g_timeout_add_seconds(1, update_stats_labels, self);
 }
@@ -17,20 +17,27 @@
  */
 
 #include "device-manager.h"
+#include "sample-ring.h"
+#include "event-trace.h"
 #include <libinput.h>
 #include <libudev.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
 #include <assert.h>
 
+#define SAMPLE_RING_CAPACITY 4096
+
 Device *device_new(const gchar *node, const gchar *name)
 {
     Device *device = g_new0(Device, 1);
     device->node = g_strdup(node);
     device->name = g_strdup(name);
     device->libinput_device = NULL;
-    memset(&device->saved_accel_settings, 0, sizeof(AccelSettings));
 
     return device;
 }
@@ -49,12 +56,65 @@ struct _DeviceManager
 {
     struct libinput *libinput_context;
     GIOChannel *gio_channel;
+    guint gio_watch_id;
     GList *devices;
+    // Read atomically by the capture thread
     Device *current_device;
-    void (*on_speed)(double speed_unaccel, gpointer user_data);
+    SpeedCallback on_speed;
     gpointer user_data;
+    DeviceCallback on_device_added;
+    DeviceCallback on_device_removed;
+    gpointer device_callbacks_user_data;
+    // Hotplug, kept open for the lifetime of the manager
+    struct udev *udev;
+    struct udev_monitor *udev_monitor;
+    guint udev_watch_id;
     AccelSettingsManager *accel_settings_manager;
     MovementType movement_type;
+
+    // Threaded capture: the capture thread owns libinput_context while it runs
+    // and hands samples to the main loop through sample_ring.
+    gboolean threaded_capture;
+    GThread *capture_thread;
+    int capture_wakeup_fds[2];
+    SampleRing *sample_ring;
+    GSource *sample_ring_source;
+    gint sample_ring_drain_scheduled;
+    // Ring overflows already warned about
+    guint reported_dropped_samples;
+
+    // Runs apply/restore tasks off the main thread, one at a time
+    GThreadPool *settings_pool;
+    // Device node -> AccelSettings from before the first unrestored apply.
+    // Only touched by settings_pool.
+    GHashTable *saved_accel_settings;
+    // Device the unrestored applies went to, restore and keep target it
+    // rather than current_device which may have changed or been unplugged
+    // since. Main thread only.
+    gchar *applied_node;
+    gchar *applied_name;
+
+    // Timing of events that don't come from a device: replays and
+    // device_manager_process_events
+    SpeedStream streams[EVENT_TRACE_SOURCE_COUNT];
+    // Read atomically by the capture thread
+    SpeedEstimator speed_estimator;
+    guint scroll_sources;
+    // Guards the published stats of every device
+    GMutex stats_mutex;
+
+    // Recording: written by whichever thread dispatches libinput events,
+    // only swapped while capture is stopped.
+    EventTraceWriter *trace_writer;
+
+    // Replay: live capture is stopped while a trace is replayed
+    EventTrace *replay_trace;
+    EventTraceIter replay_iter;
+    EventTraceEvent replay_next_event;
+    gboolean replay_has_next_event;
+    GSource *replay_source;
+    gint64 replay_start_monotonic_usec;
+    uint64_t replay_start_time_usec;
 };
 
 static int open_restricted(const char *path, int flags, void *user_data)
@@ -75,75 +135,180 @@ static const struct libinput_interface libinput_interface = {
     .close_restricted = close_restricted,
 };
 
-static void handle_motion(struct libinput *li, struct libinput_event *ev)
+static void emit_speed(DeviceManager *manager, SpeedSample *sample)
 {
-    DeviceManager *manager = libinput_get_user_data(li);
-    if (manager->movement_type != MOVEMENT_TYPE_MOTION || !manager->on_speed)
+    // Only the capture thread goes through the ring, replay and the main loop
+    // watch run on the main thread.
+    if (!manager->capture_thread)
+    {
+        sample->delivery_time_usec = sample->dequeue_time_usec;
+        manager->on_speed(sample, manager->user_data);
         return;
+    }
 
-    struct libinput_event_pointer *p = libinput_event_get_pointer_event(ev);
-    double dx_unaccel = libinput_event_pointer_get_dx_unaccelerated(p),
-           dy_unaccel = libinput_event_pointer_get_dy_unaccelerated(p);
-
-    static uint64_t last_time_usec = 0;
-    uint64_t time_usec = libinput_event_pointer_get_time_usec(p);
-    double dt_ms = (time_usec - last_time_usec) / 1000.0;
-    last_time_usec = time_usec;
-    if (dt_ms <= 0)
+    if (!sample_ring_push(manager->sample_ring, sample))
+        return;
+    // Wake the main loop once per batch, not once per sample
+    if (g_atomic_int_compare_and_exchange(&manager->sample_ring_drain_scheduled, 0, 1))
+        g_source_set_ready_time(manager->sample_ring_source, 0);
+}
+
+// device is NULL for events that don't come from a libinput device
+// dequeue_time_usec is 0 for events that weren't captured live
+static void process_speed(DeviceManager *manager, Device *device, EventTraceSource source,
+                          uint64_t time_usec, uint64_t dequeue_time_usec, double dx, double dy)
+{
+    SpeedStream *stream = device ? &device->streams[source] : &manager->streams[source];
+    // Both estimators are kept current so they can be switched at any time
+    pointer_tracker_feed(&stream->tracker, dx, dy, time_usec);
+    stream->pending_dx += dx;
+    stream->pending_dy += dy;
+    double dt_ms = custom_accel_get_dt_ms(&stream->last_time_usec, time_usec);
+    double two_events_speed = NAN;
+    if (dt_ms > 0)
+    {
+        two_events_speed = hypot(stream->pending_dx, stream->pending_dy) / dt_ms;
+        stream->pending_dx = stream->pending_dy = 0;
+    }
+
+    double speed_unaccel;
+    if (g_atomic_int_get((gint *)&manager->speed_estimator) == SPEED_ESTIMATOR_LIBINPUT)
+        speed_unaccel = pointer_tracker_get_velocity(&stream->tracker, time_usec);
+    else if (!isnan(two_events_speed))
+        speed_unaccel = two_events_speed;
+    else
         return;
-    if (dt_ms > 1000)
-        dt_ms = 7;
 
-    double speed_unaccel = hypot(dx_unaccel, dy_unaccel) / dt_ms;
-    manager->on_speed(speed_unaccel, manager->user_data);
+    if (device)
+    {
+        DeviceStats *stats = &device->stats;
+        stats->n_events[source]++;
+        stats->speed_sum[source] += speed_unaccel;
+        stats->max_speed[source] = MAX(stats->max_speed[source], speed_unaccel);
+        // Only the publish takes the lock, a few times a second rather than
+        // on every event of an 8 kHz mouse
+        if (time_usec - device->stats_published_time_usec >= DEVICE_STATS_PUBLISH_INTERVAL_USEC)
+        {
+            g_mutex_lock(&manager->stats_mutex);
+            device->published_stats = *stats;
+            g_mutex_unlock(&manager->stats_mutex);
+            device->stats_published_time_usec = time_usec;
+        }
+        if (device != g_atomic_pointer_get(&manager->current_device))
+            return;
+    }
+
+    MovementType movement_type = source == EVENT_TRACE_SOURCE_MOTION ? MOVEMENT_TYPE_MOTION : MOVEMENT_TYPE_SCROLL;
+    if (g_atomic_int_get((gint *)&manager->movement_type) != movement_type || !manager->on_speed)
+        return;
+    if (movement_type == MOVEMENT_TYPE_SCROLL && !((guint)g_atomic_int_get((gint *)&manager->scroll_sources) & (1u << source)))
+        return;
+    SpeedSample sample = {
+        .time_usec = time_usec,
+        .dequeue_time_usec = dequeue_time_usec,
+        .dx = dx,
+        .dy = dy,
+        .speed = speed_unaccel,
+    };
+    emit_speed(manager, &sample);
 }
 
-static void handle_scroll(struct libinput *li, struct libinput_event *ev)
+static void process_event(DeviceManager *manager, Device *device, const WheelClickAngle *wheel_click_angle,
+                          const EventTraceEvent *event, uint64_t dequeue_time_usec)
 {
-    DeviceManager *manager = libinput_get_user_data(li);
-    if (manager->movement_type != MOVEMENT_TYPE_SCROLL || !manager->on_speed)
+    switch (event->source)
+    {
+    case EVENT_TRACE_SOURCE_MOTION:
+        process_speed(manager, device, event->source, event->time_usec, dequeue_time_usec, event->dx, event->dy);
+        break;
+    case EVENT_TRACE_SOURCE_WHEEL:
+        // v120 keeps the fractions of a detent hi-res wheels report, scaled to
+        // degrees by the wheel's own click angle
+        process_speed(manager, device, event->source, event->time_usec, dequeue_time_usec,
+                      event->v120_x * wheel_click_angle->x / 120, event->v120_y * wheel_click_angle->y / 120);
+        break;
+    default:
+        process_speed(manager, device, event->source, event->time_usec, dequeue_time_usec,
+                      event->scroll_x, event->scroll_y);
+        break;
+    }
+}
+
+static void handle_pointer_event(DeviceManager *manager, struct libinput_event *ev, const EventTraceEvent *event,
+                                 uint64_t dequeue_time_usec)
+{
+    // Cleared before a device is removed from the context
+    Device *device = libinput_device_get_user_data(libinput_event_get_device(ev));
+    if (!device)
         return;
+    // Recordings hold a single stream, the one that is plotted
+    if (manager->trace_writer && device == g_atomic_pointer_get(&manager->current_device))
+        event_trace_writer_append(manager->trace_writer, event);
+    process_event(manager, device, &device->wheel_click_angle, event, dequeue_time_usec);
+}
 
+static void handle_motion(struct libinput *li, struct libinput_event *ev, uint64_t dequeue_time_usec)
+{
+    DeviceManager *manager = libinput_get_user_data(li);
     struct libinput_event_pointer *p = libinput_event_get_pointer_event(ev);
-    static uint64_t last_time_usec = 0;
-    uint64_t time_usec = libinput_event_pointer_get_time_usec(p);
-    double dt_ms = (time_usec - last_time_usec) / 1000.0;
-    last_time_usec = time_usec;
-    if (dt_ms <= 0)
-        return;
-    if (dt_ms > 1000)
-        dt_ms = 7;
+    EventTraceEvent event = {
+        .time_usec = libinput_event_pointer_get_time_usec(p),
+        .source = EVENT_TRACE_SOURCE_MOTION,
+        .dx = libinput_event_pointer_get_dx_unaccelerated(p),
+        .dy = libinput_event_pointer_get_dy_unaccelerated(p),
+    };
+    handle_pointer_event(manager, ev, &event, dequeue_time_usec);
+}
 
-    double dx = 0, dy = 0;
+static void handle_scroll(struct libinput *li, struct libinput_event *ev, EventTraceSource source, uint64_t dequeue_time_usec)
+{
+    DeviceManager *manager = libinput_get_user_data(li);
+    struct libinput_event_pointer *p = libinput_event_get_pointer_event(ev);
+    EventTraceEvent event = {
+        .time_usec = libinput_event_pointer_get_time_usec(p),
+        .source = source,
+    };
     if (libinput_event_pointer_has_axis(p, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL))
-        dx = libinput_event_pointer_get_scroll_value(p, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
+    {
+        event.scroll_x = libinput_event_pointer_get_scroll_value(p, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
+        if (source == EVENT_TRACE_SOURCE_WHEEL)
+            event.v120_x = libinput_event_pointer_get_scroll_value_v120(p, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
+    }
 
     if (libinput_event_pointer_has_axis(p, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
-        dy = libinput_event_pointer_get_scroll_value(p, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
+    {
+        event.scroll_y = libinput_event_pointer_get_scroll_value(p, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
+        if (source == EVENT_TRACE_SOURCE_WHEEL)
+            event.v120_y = libinput_event_pointer_get_scroll_value_v120(p, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
+    }
 
-    double speed_unaccel = hypot(dx, dy) / dt_ms;
-    manager->on_speed(speed_unaccel, manager->user_data);
+    handle_pointer_event(manager, ev, &event, dequeue_time_usec);
 }
 
-static gboolean handle_event_libinput(GIOChannel *source, GIOCondition condition, gpointer data)
+static void dispatch_libinput_events(struct libinput *li)
 {
-    struct libinput *li = data;
     struct libinput_event *ev;
     libinput_dispatch(li);
 
     while ((ev = libinput_get_event(li)))
     {
+        // Same clock as the kernel event times libinput reports
+        uint64_t dequeue_time_usec = g_get_monotonic_time();
         switch (libinput_event_get_type(ev))
         {
         case LIBINPUT_EVENT_NONE:
             abort();
         case LIBINPUT_EVENT_POINTER_MOTION:
-            handle_motion(li, ev);
+            handle_motion(li, ev, dequeue_time_usec);
             break;
         case LIBINPUT_EVENT_POINTER_SCROLL_WHEEL:
+            handle_scroll(li, ev, EVENT_TRACE_SOURCE_WHEEL, dequeue_time_usec);
+            break;
         case LIBINPUT_EVENT_POINTER_SCROLL_FINGER:
+            handle_scroll(li, ev, EVENT_TRACE_SOURCE_FINGER, dequeue_time_usec);
+            break;
         case LIBINPUT_EVENT_POINTER_SCROLL_CONTINUOUS:
-            handle_scroll(li, ev);
+            handle_scroll(li, ev, EVENT_TRACE_SOURCE_CONTINUOUS, dequeue_time_usec);
             break;
         default:
             break;
@@ -151,95 +316,502 @@ static gboolean handle_event_libinput(GIOChannel *source, GIOCondition condition
 
         libinput_event_destroy(ev);
     }
+}
 
+static gboolean handle_event_libinput(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    dispatch_libinput_events(data);
     return TRUE;
 }
 
-DeviceManager *device_manager_new(AccelSettingsManager *accel_settings_manager)
+static gpointer capture_thread_func(gpointer data)
 {
-    DeviceManager *manager = g_new0(DeviceManager, 1);
-    manager->current_device = NULL;
-    manager->movement_type = MOVEMENT_TYPE_MOTION;
-    manager->accel_settings_manager = accel_settings_manager;
+    DeviceManager *manager = data;
+    struct pollfd fds[2] = {
+        {.fd = libinput_get_fd(manager->libinput_context), .events = POLLIN},
+        {.fd = manager->capture_wakeup_fds[0], .events = POLLIN},
+    };
 
-    manager->libinput_context = libinput_path_create_context(&libinput_interface, NULL);
-    if (!manager->libinput_context)
+    while (TRUE)
     {
-        g_warning("Failed to create libinput context");
-        g_free(manager);
-        return NULL;
+        if (poll(fds, G_N_ELEMENTS(fds), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            g_warning("Capture thread poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & POLLIN)
+            dispatch_libinput_events(manager->libinput_context);
     }
 
-    manager->devices = NULL;
-    struct udev *udev = udev_new();
-    if (!udev)
+    return NULL;
+}
+
+static gboolean drain_sample_ring(gpointer user_data)
+{
+    DeviceManager *manager = user_data;
+    // Clear before draining so a sample pushed meanwhile schedules another drain
+    g_atomic_int_set(&manager->sample_ring_drain_scheduled, 0);
+    // One clock read per batch, every sample in it arrived by now
+    uint64_t delivery_time_usec = g_get_monotonic_time();
+    SpeedSample sample;
+    while (sample_ring_pop(manager->sample_ring, &sample))
     {
-        g_warning("Failed to create udev context");
-        libinput_unref(manager->libinput_context);
-        g_free(manager);
-        return NULL;
+        if (sample.dequeue_time_usec)
+            sample.delivery_time_usec = delivery_time_usec;
+        if (manager->on_speed)
+            manager->on_speed(&sample, manager->user_data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean sample_ring_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    g_source_set_ready_time(source, -1);
+    return callback(user_data);
+}
+
+static GSourceFuncs sample_ring_source_funcs = {
+    .dispatch = sample_ring_source_dispatch,
+};
+
+// The libinput context is not thread safe, stop whoever currently reads it
+// before touching it from the main thread.
+static void stop_capture(DeviceManager *manager)
+{
+    if (manager->capture_thread)
+    {
+        char wakeup = 0;
+        if (write(manager->capture_wakeup_fds[1], &wakeup, 1) != 1)
+            g_warning("Failed to wake capture thread: %s", strerror(errno));
+        g_thread_join(manager->capture_thread);
+        manager->capture_thread = NULL;
+        if (read(manager->capture_wakeup_fds[0], &wakeup, 1) != 1)
+            g_warning("Failed to reset capture thread wakeup: %s", strerror(errno));
+        guint dropped = sample_ring_get_dropped(manager->sample_ring);
+        if (dropped > manager->reported_dropped_samples)
+        {
+            g_warning("Dropped %u speed samples, the main loop fell behind the capture thread",
+                      dropped - manager->reported_dropped_samples);
+            manager->reported_dropped_samples = dropped;
+        }
+    }
+    if (manager->gio_watch_id > 0)
+    {
+        g_source_remove(manager->gio_watch_id);
+        manager->gio_watch_id = 0;
+    }
+}
+
+static void start_capture(DeviceManager *manager)
+{
+    g_assert(!manager->capture_thread && manager->gio_watch_id == 0);
+    // Resumed when the replay finishes
+    if (manager->replay_source)
+        return;
+    if (manager->threaded_capture)
+    {
+        manager->capture_thread = g_thread_new("libinput-capture", capture_thread_func, manager);
+    }
+    else
+    {
+        manager->gio_watch_id = g_io_add_watch(manager->gio_channel, G_IO_IN, handle_event_libinput, manager->libinput_context);
+    }
+}
+
+// udev tags every pointer-like device with one of these, anything else
+// (keyboards, joysticks, switches...) is never opened
+static const char *const POINTER_UDEV_PROPERTIES[] = {
+    "ID_INPUT_MOUSE",
+    "ID_INPUT_TOUCHPAD",
+    "ID_INPUT_POINTINGSTICK",
+    "ID_INPUT_TRACKBALL",
+};
+
+typedef struct
+{
+    char *devnode;
+    // Set by the probe
+    char *name;
+    gboolean is_pointer;
+} ProbeCandidate;
+
+static void probe_candidate(gpointer data, gpointer user_data)
+{
+    ProbeCandidate *candidate = data;
+    // libinput contexts aren't thread safe, every probe gets its own
+    struct libinput *libinput_context = libinput_path_create_context(&libinput_interface, NULL);
+    if (!libinput_context)
+        return;
+    struct libinput_device *libinput_device = libinput_path_add_device(libinput_context, candidate->devnode);
+    if (libinput_device)
+    {
+        candidate->is_pointer = libinput_device_has_capability(libinput_device, LIBINPUT_DEVICE_CAP_POINTER);
+        candidate->name = g_strdup(libinput_device_get_name(libinput_device));
+        libinput_path_remove_device(libinput_device);
+    }
+    libinput_unref(libinput_context);
+}
+
+// Same properties and precedence as libinput: a click count overrides the
+// angle, and the horizontal wheel falls back to the vertical one
+static double get_wheel_click_angle(struct udev_device *udev_device, const char *count_property,
+                                    const char *angle_property, double fallback)
+{
+    const char *value = udev_device_get_property_value(udev_device, count_property);
+    gint64 count = value ? g_ascii_strtoll(value, NULL, 10) : 0;
+    if (count != 0 && ABS(count) <= 360)
+        return 360.0 / count;
+    value = udev_device_get_property_value(udev_device, angle_property);
+    gint64 angle = value ? g_ascii_strtoll(value, NULL, 10) : 0;
+    if (angle != 0 && ABS(angle) <= 360)
+        return angle;
+    return fallback;
+}
+
+static void read_wheel_click_angle(Device *device)
+{
+    device->wheel_click_angle.x = device->wheel_click_angle.y = WHEEL_DEFAULT_CLICK_ANGLE;
+    struct udev_device *udev_device = libinput_device_get_udev_device(device->libinput_device);
+    if (!udev_device)
+        return;
+    device->wheel_click_angle.y = get_wheel_click_angle(udev_device, "MOUSE_WHEEL_CLICK_COUNT", "MOUSE_WHEEL_CLICK_ANGLE",
+                                                        WHEEL_DEFAULT_CLICK_ANGLE);
+    device->wheel_click_angle.x = get_wheel_click_angle(udev_device, "MOUSE_WHEEL_CLICK_COUNT_HORIZONTAL",
+                                                        "MOUSE_WHEEL_CLICK_ANGLE_HORIZONTAL", device->wheel_click_angle.y);
+    udev_device_unref(udev_device);
+}
+
+// Adds the device to the capture context. The libinput context must not be
+// in use by the capture thread.
+static gboolean attach_device(DeviceManager *manager, Device *device)
+{
+    device->libinput_device = libinput_path_add_device(manager->libinput_context, device->node);
+    if (!device->libinput_device)
+    {
+        g_warning("Failed to add libinput device: %s", device->node);
+        return FALSE;
     }
+    read_wheel_click_angle(device);
+    // Our reference keeps the pointer valid after the kernel removed the
+    // node and libinput dropped the device on its own
+    libinput_device_ref(device->libinput_device);
+    libinput_device_set_user_data(device->libinput_device, device);
+    return TRUE;
+}
 
+static void detach_device(Device *device)
+{
+    if (!device->libinput_device)
+        return;
+    // Events still queued for it are ignored from now on
+    libinput_device_set_user_data(device->libinput_device, NULL);
+    libinput_path_remove_device(device->libinput_device);
+    libinput_device_unref(device->libinput_device);
+    device->libinput_device = NULL;
+}
+
+static void scan_devices(DeviceManager *manager, struct udev *udev)
+{
+    gint64 start_time = g_get_monotonic_time();
+
+    // Only event nodes carry the classification, the inputN parents and
+    // legacy mouseN/jsN nodes would be duplicates
     struct udev_enumerate *enumerate = udev_enumerate_new(udev);
     udev_enumerate_add_match_subsystem(enumerate, "input");
-    // udev_enumerate_add_match_property(enumerate, "ID_INPUT_MOUSE", "1");
-    // udev_enumerate_add_match_property(enumerate, "ID_INPUT_TOUCHPAD", "1");
+    udev_enumerate_add_match_sysname(enumerate, "event*");
+    // Property matches are ORed
+    for (guint i = 0; i < G_N_ELEMENTS(POINTER_UDEV_PROPERTIES); i++)
+        udev_enumerate_add_match_property(enumerate, POINTER_UDEV_PROPERTIES[i], "1");
     udev_enumerate_scan_devices(enumerate);
 
-    struct udev_list_entry *devices = udev_enumerate_get_list_entry(enumerate);
+    GArray *candidates = g_array_new(FALSE, TRUE, sizeof(ProbeCandidate));
     struct udev_list_entry *entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate))
+    {
+        struct udev_device *udev_device = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+        if (!udev_device)
+            continue;
+        const char *devnode = udev_device_get_devnode(udev_device);
+        if (devnode)
+        {
+            ProbeCandidate candidate = {.devnode = g_strdup(devnode)};
+            g_array_append_val(candidates, candidate);
+        }
+        udev_device_unref(udev_device);
+    }
+    udev_enumerate_unref(enumerate);
+    gint64 enumerate_end_time = g_get_monotonic_time();
 
-    udev_list_entry_foreach(entry, devices)
+    // Opening a node can block on slow devices, probe them side by side.
+    // The array isn't resized anymore, so the elements stay put.
+    GThreadPool *pool = NULL;
+    if (candidates->len > 1)
+        pool = g_thread_pool_new(probe_candidate, NULL, MIN(candidates->len, (guint)g_get_num_processors()), TRUE, NULL);
+    for (guint i = 0; i < candidates->len; i++)
     {
-        const char *path = udev_list_entry_get_name(entry);
-        struct udev_device *udev_device = udev_device_new_from_syspath(udev, path);
+        ProbeCandidate *candidate = &g_array_index(candidates, ProbeCandidate, i);
+        if (pool)
+            g_thread_pool_push(pool, candidate, NULL);
+        else
+            probe_candidate(candidate, NULL);
+    }
+    if (pool)
+        g_thread_pool_free(pool, FALSE, TRUE);
+    gint64 probe_end_time = g_get_monotonic_time();
 
-        if (udev_device)
+    // Keep udev's order, the results came back in whatever order
+    guint ndevices = 0;
+    for (guint i = 0; i < candidates->len; i++)
+    {
+        ProbeCandidate *candidate = &g_array_index(candidates, ProbeCandidate, i);
+        if (candidate->is_pointer)
         {
-            const char *devnode = udev_device_get_devnode(udev_device);
-            if (!devnode)
-            {
-                udev_device_unref(udev_device);
-                continue;
-            }
-            struct libinput_device *libinput_device = libinput_path_add_device(manager->libinput_context, devnode);
-            if (!libinput_device)
+            g_print("Found device: %s, node: %s\n", candidate->name, candidate->devnode);
+            Device *device = device_new(candidate->devnode, candidate->name);
+            if (attach_device(manager, device))
             {
-                // g_printerr("Failed to add libinput device: %s\n", devnode);
-                udev_device_unref(udev_device);
-                continue;
+                manager->devices = g_list_append(manager->devices, device);
+                ndevices++;
             }
-            if (!libinput_device_has_capability(libinput_device, LIBINPUT_DEVICE_CAP_POINTER))
+            else
             {
-                libinput_path_remove_device(libinput_device);
-                udev_device_unref(udev_device);
-                continue;
+                device_free(device);
             }
-            const char *device_name = libinput_device_get_name(libinput_device);
-            g_print("Found device: %s, node: %s\n", device_name, devnode);
-            Device *device = device_new(devnode, device_name);
+        }
+        g_free(candidate->devnode);
+        g_free(candidate->name);
+    }
+
+    g_print("Enumerated %u devices from %u candidates: udev %.1f ms, probe %.1f ms, total %.1f ms\n",
+            ndevices, candidates->len,
+            (enumerate_end_time - start_time) / 1000.0,
+            (probe_end_time - enumerate_end_time) / 1000.0,
+            (g_get_monotonic_time() - start_time) / 1000.0);
+    g_array_free(candidates, TRUE);
+}
+
+static gboolean is_pointer_candidate(struct udev_device *udev_device)
+{
+    const char *sysname = udev_device_get_sysname(udev_device);
+    if (!sysname || !g_str_has_prefix(sysname, "event") || !udev_device_get_devnode(udev_device))
+        return FALSE;
+    for (guint i = 0; i < G_N_ELEMENTS(POINTER_UDEV_PROPERTIES); i++)
+    {
+        if (g_strcmp0(udev_device_get_property_value(udev_device, POINTER_UDEV_PROPERTIES[i]), "1") == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static GList *find_device_by_node(DeviceManager *manager, const char *node, guint *position)
+{
+    *position = 0;
+    for (GList *l = manager->devices; l != NULL; l = l->next, (*position)++)
+    {
+        if (g_strcmp0(((Device *)l->data)->node, node) == 0)
+            return l;
+    }
+    return NULL;
+}
+
+static void add_hotplugged_device(DeviceManager *manager, struct udev_device *udev_device)
+{
+    guint position;
+    const char *devnode = udev_device_get_devnode(udev_device);
+    if (!is_pointer_candidate(udev_device) || find_device_by_node(manager, devnode, &position))
+        return;
+
+    ProbeCandidate candidate = {.devnode = g_strdup(devnode)};
+    probe_candidate(&candidate, NULL);
+    if (candidate.is_pointer)
+    {
+        g_print("Device added: %s, node: %s\n", candidate.name, candidate.devnode);
+        Device *device = device_new(candidate.devnode, candidate.name);
+        stop_capture(manager);
+        gboolean attached = attach_device(manager, device);
+        start_capture(manager);
+        if (attached)
+        {
             manager->devices = g_list_append(manager->devices, device);
-            libinput_path_remove_device(libinput_device);
-            udev_device_unref(udev_device);
+            if (manager->on_device_added)
+                manager->on_device_added(position, candidate.name, manager->device_callbacks_user_data);
+        }
+        else
+        {
+            device_free(device);
         }
     }
+    g_free(candidate.devnode);
+    g_free(candidate.name);
+}
 
-    udev_enumerate_unref(enumerate);
-    udev_unref(udev);
+static void forget_accel_settings(DeviceManager *manager, const char *node);
+
+static void remove_hotplugged_device(DeviceManager *manager, struct udev_device *udev_device)
+{
+    guint position;
+    GList *link = find_device_by_node(manager, udev_device_get_devnode(udev_device), &position);
+    if (!link)
+        return;
+
+    Device *device = link->data;
+    g_print("Device removed: %s, node: %s\n", device->name, device->node);
+    // The capture thread may be dispatching its events
+    stop_capture(manager);
+    if (device == manager->current_device)
+        g_atomic_pointer_set(&manager->current_device, NULL);
+    detach_device(device);
+    start_capture(manager);
+    // A device with the same node later on is a new one, don't restore it
+    // to settings saved from this one
+    forget_accel_settings(manager, device->node);
+    manager->devices = g_list_delete_link(manager->devices, link);
+    if (manager->on_device_removed)
+        manager->on_device_removed(position, device->name, manager->device_callbacks_user_data);
+    device_free(device);
+}
+
+static gboolean handle_udev_event(gint fd, GIOCondition condition, gpointer user_data)
+{
+    DeviceManager *manager = user_data;
+    struct udev_device *udev_device;
+    while ((udev_device = udev_monitor_receive_device(manager->udev_monitor)))
+    {
+        const char *action = udev_device_get_action(udev_device);
+        if (g_strcmp0(action, "add") == 0)
+            add_hotplugged_device(manager, udev_device);
+        else if (g_strcmp0(action, "remove") == 0)
+            remove_hotplugged_device(manager, udev_device);
+        udev_device_unref(udev_device);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void start_udev_monitor(DeviceManager *manager)
+{
+    manager->udev_monitor = udev_monitor_new_from_netlink(manager->udev, "udev");
+    if (!manager->udev_monitor)
+    {
+        g_warning("Failed to create udev monitor, devices plugged in later won't be listed");
+        return;
+    }
+    udev_monitor_filter_add_match_subsystem_devtype(manager->udev_monitor, "input", NULL);
+    if (udev_monitor_enable_receiving(manager->udev_monitor) < 0)
+    {
+        g_warning("Failed to enable udev monitor, devices plugged in later won't be listed");
+        g_clear_pointer(&manager->udev_monitor, udev_monitor_unref);
+        return;
+    }
+    manager->udev_watch_id = g_unix_fd_add(udev_monitor_get_fd(manager->udev_monitor), G_IO_IN, handle_udev_event, manager);
+}
+
+static DeviceManager *device_manager_create(AccelSettingsManager *accel_settings_manager, gboolean with_devices)
+{
+    DeviceManager *manager = g_new0(DeviceManager, 1);
+    manager->current_device = NULL;
+    manager->movement_type = MOVEMENT_TYPE_MOTION;
+    manager->scroll_sources = SCROLL_SOURCES_ALL;
+    manager->accel_settings_manager = accel_settings_manager;
+    g_mutex_init(&manager->stats_mutex);
+
+    manager->libinput_context = libinput_path_create_context(&libinput_interface, NULL);
+    if (!manager->libinput_context)
+    {
+        g_warning("Failed to create libinput context");
+        g_free(manager);
+        return NULL;
+    }
+
+    manager->devices = NULL;
+    if (with_devices)
+    {
+        manager->udev = udev_new();
+        if (!manager->udev)
+        {
+            g_warning("Failed to create udev context");
+            libinput_unref(manager->libinput_context);
+            g_free(manager);
+            return NULL;
+        }
+        // Monitor first so nothing plugged in during the scan is missed,
+        // duplicates are ignored by node
+        start_udev_monitor(manager);
+        scan_devices(manager, manager->udev);
+    }
 
     libinput_set_user_data(manager->libinput_context, manager);
 
     manager->gio_channel = g_io_channel_unix_new(libinput_get_fd(manager->libinput_context));
     g_io_channel_set_encoding(manager->gio_channel, NULL, NULL);
-    g_io_add_watch(manager->gio_channel, G_IO_IN, handle_event_libinput, manager->libinput_context);
+
+    GError *error = NULL;
+    if (!g_unix_open_pipe(manager->capture_wakeup_fds, FD_CLOEXEC, &error))
+    {
+        g_warning("Failed to create capture thread wakeup pipe: %s", error->message);
+        g_error_free(error);
+        manager->capture_wakeup_fds[0] = manager->capture_wakeup_fds[1] = -1;
+    }
+    manager->sample_ring = sample_ring_new(SAMPLE_RING_CAPACITY);
+    manager->sample_ring_source = g_source_new(&sample_ring_source_funcs, sizeof(GSource));
+    g_source_set_callback(manager->sample_ring_source, drain_sample_ring, manager, NULL);
+    g_source_attach(manager->sample_ring_source, NULL);
+
+    manager->settings_pool = g_thread_pool_new(run_settings_task, manager, 1, FALSE, NULL);
+    manager->saved_accel_settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    start_capture(manager);
 
     return manager;
 }
 
+DeviceManager *device_manager_new(AccelSettingsManager *accel_settings_manager)
+{
+    return device_manager_create(accel_settings_manager, TRUE);
+}
+
+DeviceManager *device_manager_new_without_devices(AccelSettingsManager *accel_settings_manager)
+{
+    return device_manager_create(accel_settings_manager, FALSE);
+}
+
 void device_manager_free(DeviceManager *manager)
 {
     if (manager)
     {
+        device_manager_stop_replay(manager);
+        stop_capture(manager);
+        manager->current_device = NULL;
+        g_list_foreach(manager->devices, (GFunc)detach_device, NULL);
+        if (manager->udev_watch_id > 0)
+            g_source_remove(manager->udev_watch_id);
+        if (manager->udev_monitor)
+            udev_monitor_unref(manager->udev_monitor);
+        if (manager->udev)
+            udev_unref(manager->udev);
+        if (manager->trace_writer)
+            event_trace_writer_close(manager->trace_writer, NULL);
+        // Let a queued restore finish before the settings manager goes away
+        if (manager->settings_pool)
+            g_thread_pool_free(manager->settings_pool, FALSE, TRUE);
+        if (manager->saved_accel_settings)
+            g_hash_table_destroy(manager->saved_accel_settings);
+        g_free(manager->applied_node);
+        g_free(manager->applied_name);
+        if (manager->sample_ring_source)
+        {
+            g_source_destroy(manager->sample_ring_source);
+            g_source_unref(manager->sample_ring_source);
+        }
+        sample_ring_free(manager->sample_ring);
+        if (manager->capture_wakeup_fds[0] >= 0)
+        {
+            close(manager->capture_wakeup_fds[0]);
+            close(manager->capture_wakeup_fds[1]);
+        }
         if (manager->libinput_context)
             libinput_unref(manager->libinput_context);
         if (manager->devices)
@@ -248,6 +820,7 @@ void device_manager_free(DeviceManager *manager)
             g_io_channel_unref(manager->gio_channel);
         if (manager->accel_settings_manager)
             manager->accel_settings_manager->free(manager->accel_settings_manager);
+        g_mutex_clear(&manager->stats_mutex);
         g_free(manager);
     }
 }
@@ -263,46 +836,238 @@ GtkStringList *device_manager_get_device_names(DeviceManager *manager)
     return device_names;
 }
 
-void device_manager_set_speed_callback(DeviceManager *manager, void (*on_speed)(double speed, gpointer user_data), gpointer user_data)
+GtkStringList *device_manager_get_device_nodes(DeviceManager *manager)
+{
+    GtkStringList *device_nodes = gtk_string_list_new(NULL);
+    for (GList *l = manager->devices; l != NULL; l = l->next)
+    {
+        Device *device = (Device *)l->data;
+        gtk_string_list_append(device_nodes, device->node);
+    }
+    return device_nodes;
+}
+
+void device_manager_set_speed_callback(DeviceManager *manager, SpeedCallback on_speed, gpointer user_data)
 {
     manager->on_speed = on_speed;
     manager->user_data = user_data;
 }
 
-void device_manager_set_current_device(DeviceManager *manager, const char *device_name)
+void device_manager_set_device_callbacks(DeviceManager *manager, DeviceCallback on_device_added, DeviceCallback on_device_removed,
+                                         gpointer user_data)
 {
-    g_assert(manager);
-    if (manager->current_device && manager->current_device->libinput_device)
-    {
-        libinput_path_remove_device(manager->current_device->libinput_device);
-        manager->current_device->libinput_device = NULL;
-    }
+    manager->on_device_added = on_device_added;
+    manager->on_device_removed = on_device_removed;
+    manager->device_callbacks_user_data = user_data;
+}
 
-    manager->current_device = NULL;
-    if (!device_name)
-        return;
-    for (GList *l = manager->devices; l != NULL; l = l->next)
+static void set_current_device(DeviceManager *manager, const char *device_name)
+{
+    Device *current_device = NULL;
+    for (GList *l = device_name ? manager->devices : NULL; l != NULL; l = l->next)
     {
         Device *device = (Device *)l->data;
         if (g_strcmp0(device->name, device_name) == 0)
         {
-            manager->current_device = device;
+            current_device = device;
             break;
         }
     }
+    if (device_name && !current_device)
+        g_warning("Device manager did not found device: %s", device_name);
+    g_atomic_pointer_set(&manager->current_device, current_device);
+}
+
+void device_manager_set_current_device(DeviceManager *manager, const char *device_name)
+{
+    g_assert(manager);
+    // The devices stay in the libinput context, only the routing changes
+    set_current_device(manager, device_name);
+}
+
+guint device_manager_get_dropped_samples(DeviceManager *manager)
+{
+    return sample_ring_get_dropped(manager->sample_ring);
+}
+
+gboolean device_manager_get_device_stats(DeviceManager *manager, const char *device_node, DeviceStats *stats)
+{
+    g_assert(manager);
+    guint position;
+    GList *link = find_device_by_node(manager, device_node, &position);
+    if (!link)
+        return FALSE;
+    g_mutex_lock(&manager->stats_mutex);
+    *stats = ((Device *)link->data)->published_stats;
+    g_mutex_unlock(&manager->stats_mutex);
+    return TRUE;
+}
+
+void device_manager_set_scroll_sources(DeviceManager *manager, guint source_mask)
+{
+    g_assert(manager);
+    g_atomic_int_set((gint *)&manager->scroll_sources, source_mask & SCROLL_SOURCES_ALL);
+}
+
+void device_manager_set_speed_estimator(DeviceManager *manager, SpeedEstimator speed_estimator)
+{
+    g_assert(manager && speed_estimator < SPEED_ESTIMATOR_COUNT);
+    g_atomic_int_set((gint *)&manager->speed_estimator, speed_estimator);
+}
 
-    if (!manager->current_device)
+void device_manager_set_threaded_capture(DeviceManager *manager, gboolean threaded_capture)
+{
+    g_assert(manager);
+    threaded_capture = !!threaded_capture;
+    if (manager->threaded_capture == threaded_capture)
+        return;
+    if (threaded_capture && manager->capture_wakeup_fds[0] < 0)
     {
-        g_warning("Device manager did not found device: %s", device_name);
+        g_warning("Threaded capture is unavailable");
         return;
     }
+    stop_capture(manager);
+    manager->threaded_capture = threaded_capture;
+    start_capture(manager);
+}
+
+gboolean device_manager_start_recording(DeviceManager *manager, const char *path, GError **error)
+{
+    g_assert(manager);
+    g_return_val_if_fail(!manager->trace_writer, FALSE);
+    // Recordings are of the current device, devices switched to later are
+    // assumed to share its wheel
+    Device *device = manager->current_device;
+    WheelClickAngle wheel_click_angle = {WHEEL_DEFAULT_CLICK_ANGLE, WHEEL_DEFAULT_CLICK_ANGLE};
+    if (device)
+        wheel_click_angle = device->wheel_click_angle;
+    EventTraceWriter *writer = event_trace_writer_new(path, &wheel_click_angle, error);
+    if (!writer)
+        return FALSE;
+    stop_capture(manager);
+    manager->trace_writer = writer;
+    start_capture(manager);
+    return TRUE;
+}
 
-    manager->current_device->libinput_device = libinput_path_add_device(manager->libinput_context, manager->current_device->node);
-    if (!manager->current_device->libinput_device)
+gboolean device_manager_stop_recording(DeviceManager *manager, GError **error)
+{
+    g_assert(manager);
+    if (!manager->trace_writer)
+        return TRUE;
+    stop_capture(manager);
+    EventTraceWriter *writer = manager->trace_writer;
+    manager->trace_writer = NULL;
+    start_capture(manager);
+    return event_trace_writer_close(writer, error);
+}
+
+gboolean device_manager_is_recording(DeviceManager *manager)
+{
+    return manager->trace_writer != NULL;
+}
+
+// Replays start from scratch, a previous trace's timestamps are meaningless
+static void reset_trace_timing(DeviceManager *manager)
+{
+    memset(manager->streams, 0, sizeof(manager->streams));
+}
+
+static gboolean replay_next_events(gpointer user_data)
+{
+    DeviceManager *manager = user_data;
+    // Deliver everything that is due, then sleep until the next event
+    uint64_t now_usec = manager->replay_start_time_usec + (g_get_monotonic_time() - manager->replay_start_monotonic_usec);
+    while (manager->replay_has_next_event && manager->replay_next_event.time_usec <= now_usec)
     {
-        g_warning("Failed to add libinput device: %s", manager->current_device->node);
-        manager->current_device = NULL;
+        process_event(manager, NULL, event_trace_get_wheel_click_angle(manager->replay_trace), &manager->replay_next_event, 0);
+        manager->replay_has_next_event = event_trace_iter_next(&manager->replay_iter, &manager->replay_next_event);
     }
+
+    if (!manager->replay_has_next_event)
+    {
+        device_manager_stop_replay(manager);
+        return G_SOURCE_REMOVE;
+    }
+    g_source_set_ready_time(manager->replay_source, manager->replay_start_monotonic_usec +
+                                                        (gint64)(manager->replay_next_event.time_usec - manager->replay_start_time_usec));
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean replay_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    return callback(user_data);
+}
+
+static GSourceFuncs replay_source_funcs = {
+    .dispatch = replay_source_dispatch,
+};
+
+gboolean device_manager_replay_trace(DeviceManager *manager, const char *path, gboolean realtime, GError **error)
+{
+    g_assert(manager);
+    EventTrace *trace = event_trace_open(path, error);
+    if (!trace)
+        return FALSE;
+
+    device_manager_stop_replay(manager);
+    // Replayed events must not interleave with live ones
+    stop_capture(manager);
+    reset_trace_timing(manager);
+
+    EventTraceIter iter;
+    EventTraceEvent event;
+    event_trace_iter_init(&iter, trace);
+    if (!realtime || !event_trace_iter_next(&iter, &event))
+    {
+        // As fast as possible, for benchmarks and reproducing a recording
+        while (event_trace_iter_next(&iter, &event))
+            process_event(manager, NULL, event_trace_get_wheel_click_angle(trace), &event, 0);
+        event_trace_free(trace);
+        reset_trace_timing(manager);
+        start_capture(manager);
+        return TRUE;
+    }
+
+    manager->replay_trace = trace;
+    manager->replay_iter = iter;
+    manager->replay_next_event = event;
+    manager->replay_has_next_event = TRUE;
+    manager->replay_start_time_usec = event.time_usec;
+    manager->replay_start_monotonic_usec = g_get_monotonic_time();
+    manager->replay_source = g_source_new(&replay_source_funcs, sizeof(GSource));
+    g_source_set_callback(manager->replay_source, replay_next_events, manager, NULL);
+    g_source_set_ready_time(manager->replay_source, 0);
+    g_source_attach(manager->replay_source, NULL);
+    return TRUE;
+}
+
+void device_manager_stop_replay(DeviceManager *manager)
+{
+    g_assert(manager);
+    if (!manager->replay_source)
+        return;
+    g_source_destroy(manager->replay_source);
+    g_source_unref(manager->replay_source);
+    manager->replay_source = NULL;
+    event_trace_free(manager->replay_trace);
+    manager->replay_trace = NULL;
+    manager->replay_has_next_event = FALSE;
+    reset_trace_timing(manager);
+    start_capture(manager);
+}
+
+void device_manager_process_events(DeviceManager *manager, const EventTraceEvent *events, gsize n_events)
+{
+    static const WheelClickAngle default_wheel_click_angle = {WHEEL_DEFAULT_CLICK_ANGLE, WHEEL_DEFAULT_CLICK_ANGLE};
+    g_assert(manager);
+    for (gsize i = 0; i < n_events; i++)
+        process_event(manager, NULL, &default_wheel_click_angle, &events[i], 0);
+}
+
+gboolean device_manager_is_replaying(DeviceManager *manager)
+{
+    return manager->replay_source != NULL;
 }
 
 void print_accel_function(CustomAccelFunction *custom_accel_function, MovementType movement_type)
@@ -326,60 +1091,224 @@ void print_accel_settings(AccelSettings *accel_settings)
     printf("\n");
 }
 
-gboolean device_manager_set_custom_accel_function(DeviceManager *manager, CustomAccelFunction *custom_accel_function)
+// Settings I/O runs on settings_pool, which runs at most one task at a time,
+// so the AccelSettingsManager connection is only ever used by one thread and
+// tasks run in the order they were queued: a restore can't overtake an
+// earlier apply nor race a later one.
+typedef enum
 {
-    if (!manager->current_device)
+    SETTINGS_TASK_APPLY,
+    SETTINGS_TASK_RESTORE,
+    SETTINGS_TASK_KEEP,
+    SETTINGS_TASK_FORGET,
+} SettingsTaskType;
+
+typedef struct
+{
+    SettingsTaskType type;
+    // Copies, the Device may go away while the task is queued
+    gchar *node;
+    gchar *name;
+    MovementType movement_type;
+    CustomAccelFunction custom_accel_function;
+    // Live preview applies come in at up to 25 Hz, for those only the saved
+    // settings (preview start) and the restored ones (preview stop) are dumped
+    gboolean preview;
+} SettingsTaskData;
+
+static void settings_task_data_free(gpointer data)
+{
+    SettingsTaskData *task_data = data;
+    g_free(task_data->node);
+    g_free(task_data->name);
+    g_free(task_data);
+}
+
+static void run_settings_task(gpointer data, gpointer user_data)
+{
+    GTask *task = data;
+    DeviceManager *manager = user_data;
+    SettingsTaskData *task_data = g_task_get_task_data(task);
+    AccelSettingsManager *accel_settings_manager = manager->accel_settings_manager;
+    // Only node and name are used by the settings managers
+    Device device = {.node = task_data->node, .name = task_data->name};
+
+    if (g_task_return_error_if_cancelled(task))
     {
-        g_warning("Setting custom accel function: No current device set");
-        return FALSE;
+        g_object_unref(task);
+        return;
     }
-    // Save current accel settings
-    if (!manager->accel_settings_manager->get_accel_settings(manager->accel_settings_manager, manager->current_device, &manager->current_device->saved_accel_settings))
+
+    AccelSettings *saved_accel_settings = g_hash_table_lookup(manager->saved_accel_settings, device.node);
+    if (task_data->type == SETTINGS_TASK_APPLY)
     {
-        g_warning("Failed to get accel settings for device: %s", manager->current_device->name);
-        return FALSE;
-    }
-    g_print("Saved accel settings for device: %s\n", manager->current_device->name);
-    print_accel_settings(&manager->current_device->saved_accel_settings);
+        AccelSettings current_settings;
+        if (!accel_settings_manager->get_accel_settings(accel_settings_manager, &device, &current_settings))
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to get accel settings for device: %s", device.name);
+            g_object_unref(task);
+            return;
+        }
+        // Save current accel settings, unless a previous apply wasn't
+        // restored or kept yet, the original ones are what to restore to
+        if (!saved_accel_settings)
+        {
+            saved_accel_settings = g_memdup2(&current_settings, sizeof(current_settings));
+            g_hash_table_insert(manager->saved_accel_settings, g_strdup(device.node), saved_accel_settings);
+            g_print("Saved accel settings for device: %s\n", device.name);
+            print_accel_settings(saved_accel_settings);
+        }
 
-    AccelSettings new_settings = manager->current_device->saved_accel_settings;
-    new_settings.custom_accel_functions[manager->movement_type] = *custom_accel_function;
-    memcpy(new_settings.profile, (uint8_t[]){0, 0, 1}, sizeof(new_settings.profile));
+        AccelSettings new_settings = current_settings;
+        new_settings.custom_accel_functions[task_data->movement_type] = task_data->custom_accel_function;
+        memcpy(new_settings.profile, (uint8_t[]){0, 0, 1}, sizeof(new_settings.profile));
 
-    g_print("New accel settings for device: %s\n", manager->current_device->name);
-    print_accel_settings(&new_settings);
+        if (!task_data->preview)
+        {
+            g_print("New accel settings for device: %s\n", device.name);
+            print_accel_settings(&new_settings);
+        }
 
-    if (!manager->accel_settings_manager->set_accel_settings(manager->accel_settings_manager, manager->current_device, &new_settings))
+        if (!accel_settings_manager->set_accel_settings(accel_settings_manager, &device, &new_settings))
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to set accel settings for device: %s", device.name);
+            g_object_unref(task);
+            return;
+        }
+    }
+    else if (task_data->type == SETTINGS_TASK_RESTORE)
     {
-        g_warning("Failed to set accel settings for device: %s", manager->current_device->name);
-        return FALSE;
+        if (!saved_accel_settings)
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No saved accel settings for device: %s", device.name);
+            g_object_unref(task);
+            return;
+        }
+        if (!accel_settings_manager->set_accel_settings(accel_settings_manager, &device, saved_accel_settings))
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to restore accel settings for device: %s", device.name);
+            g_object_unref(task);
+            return;
+        }
+        g_print("Restored accel settings for device: %s\n", device.name);
+        print_accel_settings(saved_accel_settings);
+        g_hash_table_remove(manager->saved_accel_settings, device.node);
+    }
+    else
+    {
+        // Kept or the device is gone, the next apply saves the settings it
+        // replaces
+        g_hash_table_remove(manager->saved_accel_settings, device.node);
     }
 
-    return TRUE;
+    g_task_return_boolean(task, TRUE);
+    g_object_unref(task);
 }
 
-gboolean device_manager_restore_accel_settings(DeviceManager *manager)
+static void queue_settings_task(DeviceManager *manager, SettingsTaskData *task_data, gpointer source_tag,
+                                GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
 {
-    if (!manager->current_device)
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, source_tag);
+    g_task_set_task_data(task, task_data, settings_task_data_free);
+
+    if (task_data->type == SETTINGS_TASK_APPLY)
     {
-        g_warning("Restoring accel settings: No current device set");
-        return FALSE;
+        if (!manager->current_device)
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No current device set");
+            g_object_unref(task);
+            return;
+        }
+        task_data->node = g_strdup(manager->current_device->node);
+        task_data->name = g_strdup(manager->current_device->name);
+        g_free(manager->applied_node);
+        g_free(manager->applied_name);
+        manager->applied_node = g_strdup(task_data->node);
+        manager->applied_name = g_strdup(task_data->name);
     }
-    if (!manager->accel_settings_manager->set_accel_settings(manager->accel_settings_manager, manager->current_device, &manager->current_device->saved_accel_settings))
+    else if (!task_data->node)
     {
-        g_warning("Failed to restore accel settings for device: %s", manager->current_device->name);
-        return FALSE;
+        // Restore and keep end the apply, the next one records its device
+        if (!manager->applied_node)
+        {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No accel settings applied");
+            g_object_unref(task);
+            return;
+        }
+        task_data->node = g_steal_pointer(&manager->applied_node);
+        task_data->name = g_steal_pointer(&manager->applied_name);
+    }
+    g_thread_pool_push(manager->settings_pool, task, NULL);
+}
+
+static void forget_accel_settings(DeviceManager *manager, const char *node)
+{
+    SettingsTaskData *task_data = g_new0(SettingsTaskData, 1);
+    task_data->type = SETTINGS_TASK_FORGET;
+    task_data->node = g_strdup(node);
+    if (g_strcmp0(manager->applied_node, node) == 0)
+    {
+        g_clear_pointer(&manager->applied_node, g_free);
+        g_clear_pointer(&manager->applied_name, g_free);
     }
+    queue_settings_task(manager, task_data, forget_accel_settings, NULL, NULL, NULL);
+}
+
+static void queue_apply_task(DeviceManager *manager, const CustomAccelFunction *custom_accel_function, gboolean preview,
+                             GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    SettingsTaskData *task_data = g_new0(SettingsTaskData, 1);
+    task_data->type = SETTINGS_TASK_APPLY;
+    task_data->movement_type = g_atomic_int_get((gint *)&manager->movement_type);
+    task_data->custom_accel_function = *custom_accel_function;
+    task_data->preview = preview;
+    // Both share a source tag so either finish function works on the result
+    queue_settings_task(manager, task_data, device_manager_apply_custom_accel_function_async, cancellable, callback, user_data);
+}
 
-    g_print("Restored accel settings for device: %s\n", manager->current_device->name);
-    print_accel_settings(&manager->current_device->saved_accel_settings);
+void device_manager_apply_custom_accel_function_async(DeviceManager *manager, const CustomAccelFunction *custom_accel_function,
+                                                      GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    queue_apply_task(manager, custom_accel_function, FALSE, cancellable, callback, user_data);
+}
 
-    return TRUE;
+void device_manager_preview_custom_accel_function_async(DeviceManager *manager, const CustomAccelFunction *custom_accel_function,
+                                                        GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+    queue_apply_task(manager, custom_accel_function, TRUE, cancellable, callback, user_data);
+}
+
+gboolean device_manager_apply_custom_accel_function_finish(DeviceManager *manager, GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+void device_manager_restore_accel_settings_async(DeviceManager *manager, GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback, gpointer user_data)
+{
+    SettingsTaskData *task_data = g_new0(SettingsTaskData, 1);
+    task_data->type = SETTINGS_TASK_RESTORE;
+    queue_settings_task(manager, task_data, device_manager_restore_accel_settings_async, cancellable, callback, user_data);
+}
+
+gboolean device_manager_restore_accel_settings_finish(DeviceManager *manager, GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+void device_manager_keep_accel_settings(DeviceManager *manager)
+{
+    SettingsTaskData *task_data = g_new0(SettingsTaskData, 1);
+    task_data->type = SETTINGS_TASK_KEEP;
+    queue_settings_task(manager, task_data, device_manager_keep_accel_settings, NULL, NULL, NULL);
 }
 
 void device_manager_set_movement_type(DeviceManager *manager, MovementType movement_type)
 {
-    manager->movement_type = movement_type;
+    g_atomic_int_set((gint *)&manager->movement_type, movement_type);
 }
 
 const char *MOVEMENT_TYPE_STRINGS[MOVEMENT_TYPE_COUNT] = {
@@ -20,6 +20,10 @@
 
 #include <libinput.h>
 #include <gtk/gtk.h>
+#include "custom-accel-function.h"
+#include "event-trace.h"
+#include "pointer-tracker.h"
+#include "sample-ring.h"
 
 typedef enum
 {
@@ -30,12 +34,16 @@ typedef enum
 
 extern const char *MOVEMENT_TYPE_STRINGS[MOVEMENT_TYPE_COUNT];
 
-typedef struct
+typedef enum
 {
-    double step;
-    int npoints;
-    double points[64];
-} CustomAccelFunction;
+    // Distance over time since the previous event, what libinput's custom
+    // accel profile is fed with
+    SPEED_ESTIMATOR_TWO_EVENTS,
+    // libinput's pointer trackers, averaged over several events the way the
+    // other accel profiles see the speed. The custom profile doesn't use them.
+    SPEED_ESTIMATOR_LIBINPUT,
+    SPEED_ESTIMATOR_COUNT
+} SpeedEstimator;
 
 typedef struct
 {
@@ -43,14 +51,46 @@ typedef struct
     CustomAccelFunction custom_accel_functions[MOVEMENT_TYPE_COUNT];
 } AccelSettings;
 
+// Speeds in device units per ms, of every event the device produced, per
+// event source
+typedef struct
+{
+    guint64 n_events[EVENT_TRACE_SOURCE_COUNT];
+    double speed_sum[EVENT_TRACE_SOURCE_COUNT];
+    double max_speed[EVENT_TRACE_SOURCE_COUNT];
+} DeviceStats;
+
+// Speed estimation state of one event source, sources never share timing
+typedef struct
+{
+    uint64_t last_time_usec;
+    // Deltas of events that arrived without time passing, hi-res wheels
+    // may send a burst of them. Folded into the next event's speed.
+    double pending_dx, pending_dy;
+    PointerTracker tracker;
+} SpeedStream;
+
 typedef struct
 {
     gchar *node;
     gchar *name;
     struct libinput_device *libinput_device;
-    AccelSettings saved_accel_settings;
+    // Read from udev when the device is attached
+    WheelClickAngle wheel_click_angle;
+    // Written by whichever thread dispatches libinput events
+    SpeedStream streams[EVENT_TRACE_SOURCE_COUNT];
+    DeviceStats stats;
+    uint64_t stats_published_time_usec;
+    // Copy of stats for the main loop, guarded by the manager's stats mutex
+    DeviceStats published_stats;
 } Device;
 
+// Devices publish their stats this often, in event time
+#define DEVICE_STATS_PUBLISH_INTERVAL_USEC (G_USEC_PER_SEC / 10)
+
+// Masks of (1 << EventTraceSource) for device_manager_set_scroll_sources
+#define SCROLL_SOURCES_ALL ((1u << EVENT_TRACE_SOURCE_WHEEL) | (1u << EVENT_TRACE_SOURCE_FINGER) | (1u << EVENT_TRACE_SOURCE_CONTINUOUS))
+
 typedef struct _AccelSettingsManager AccelSettingsManager;
 struct _AccelSettingsManager
 {
@@ -61,11 +101,67 @@ struct _AccelSettingsManager
 
 typedef struct _DeviceManager DeviceManager;
 
+// Called from the main loop for every sample of the plotted stream
+typedef void (*SpeedCallback)(const SpeedSample *sample, gpointer user_data);
+// position is the device's index in the list of device names
+typedef void (*DeviceCallback)(guint position, const char *device_name, gpointer user_data);
+
 DeviceManager *device_manager_new(AccelSettingsManager *accel_settings_manager);
+// No device is probed, events only come from replays and
+// device_manager_process_events. Used by the benchmarks.
+DeviceManager *device_manager_new_without_devices(AccelSettingsManager *accel_settings_manager);
 void device_manager_free(DeviceManager *manager);
 GtkStringList *device_manager_get_device_names(DeviceManager *manager);
-void device_manager_set_speed_callback(DeviceManager *manager, void (*on_speed)(double speed, gpointer user_data), gpointer user_data);
-gboolean device_manager_set_custom_accel_function(DeviceManager *manager, CustomAccelFunction *custom_accel_function);
+// Same order as the names, nodes stay unique when names don't
+GtkStringList *device_manager_get_device_nodes(DeviceManager *manager);
+void device_manager_set_speed_callback(DeviceManager *manager, SpeedCallback on_speed, gpointer user_data);
+// Called from the main loop as devices are plugged in or removed. A removed
+// current device is detached first, as if no device was selected.
+void device_manager_set_device_callbacks(DeviceManager *manager, DeviceCallback on_device_added, DeviceCallback on_device_removed,
+                                         gpointer user_data);
+// Every device is captured all the time, the current one feeds the speed
+// callback and recordings
 void device_manager_set_current_device(DeviceManager *manager, const char *device_name);
-gboolean device_manager_restore_accel_settings(DeviceManager *manager);
+// Stats as of the device's last publish, up to
+// DEVICE_STATS_PUBLISH_INTERVAL_USEC of its events behind
+gboolean device_manager_get_device_stats(DeviceManager *manager, const char *device_node, DeviceStats *stats);
+// Samples of the current device lost because the main loop didn't drain the
+// threaded capture fast enough
+guint device_manager_get_dropped_samples(DeviceManager *manager);
+// Settings I/O runs on a worker thread in the order it was requested. The
+// callbacks are invoked in the thread-default main context of the caller.
+// Restore writes back the settings from before the first apply since the
+// last restore or keep. Restore and keep act on the device the apply went to,
+// even if the current device changed since; the saved settings are dropped
+// when that device is unplugged.
+void device_manager_apply_custom_accel_function_async(DeviceManager *manager, const CustomAccelFunction *custom_accel_function,
+                                                      GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+gboolean device_manager_apply_custom_accel_function_finish(DeviceManager *manager, GAsyncResult *result, GError **error);
+// Same as apply but quiet, for live preview. Finish with
+// device_manager_apply_custom_accel_function_finish.
+void device_manager_preview_custom_accel_function_async(DeviceManager *manager, const CustomAccelFunction *custom_accel_function,
+                                                        GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+void device_manager_restore_accel_settings_async(DeviceManager *manager, GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback, gpointer user_data);
+gboolean device_manager_restore_accel_settings_finish(DeviceManager *manager, GAsyncResult *result, GError **error);
+// Forgets the saved settings, the next apply saves the ones it replaces
+void device_manager_keep_accel_settings(DeviceManager *manager);
 void device_manager_set_movement_type(DeviceManager *manager, MovementType movement_type);
+// Which scroll sources feed the speed callback in MOVEMENT_TYPE_SCROLL,
+// SCROLL_SOURCES_ALL by default
+void device_manager_set_scroll_sources(DeviceManager *manager, guint source_mask);
+void device_manager_set_speed_estimator(DeviceManager *manager, SpeedEstimator speed_estimator);
+void device_manager_set_threaded_capture(DeviceManager *manager, gboolean threaded_capture);
+gboolean device_manager_start_recording(DeviceManager *manager, const char *path, GError **error);
+gboolean device_manager_stop_recording(DeviceManager *manager, GError **error);
+gboolean device_manager_is_recording(DeviceManager *manager);
+// Feeds a recorded trace through the same path as libinput events. In
+// realtime mode the original timing is kept and live capture is paused until
+// the trace ends or device_manager_stop_replay is called.
+gboolean device_manager_replay_trace(DeviceManager *manager, const char *path, gboolean realtime, GError **error);
+void device_manager_stop_replay(DeviceManager *manager);
+gboolean device_manager_is_replaying(DeviceManager *manager);
+// Runs events through the speed computation synchronously, on the calling
+// thread, as if libinput had delivered them. Live capture must not be
+// running on a dedicated thread.
+void device_manager_process_events(DeviceManager *manager, const EventTraceEvent *events, gsize n_events);
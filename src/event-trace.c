@@ -0,0 +1,342 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "event-trace.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// File layout: a header followed by fixed-width records in host byte order.
+// Each record stores the time since the previous one, gaps that overflow 32
+// bits are bridged with EVENT_TRACE_RECORD_SKIP records.
+#define EVENT_TRACE_MAGIC "CATRACE"
+#define EVENT_TRACE_VERSION 1
+#define EVENT_TRACE_BYTE_ORDER 0x01020304u
+#define EVENT_TRACE_RECORD_SKIP 0xff
+// ~96 KiB per buffer, a few hundred milliseconds of an 8 kHz mouse
+#define EVENT_TRACE_BUFFER_RECORDS 4096
+#define EVENT_TRACE_MAX_BUFFERS 64
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t start_time_usec;
+    float wheel_click_angle_x, wheel_click_angle_y;
+} EventTraceHeader;
+
+typedef struct
+{
+    uint32_t dt_usec;
+    uint8_t source;
+    uint8_t reserved[3];
+    float dx, dy;
+    float scroll_x, scroll_y;
+    // Wheel records only. The reserved bytes can't hold both axes.
+    int16_t v120_x, v120_y;
+} EventTraceRecord;
+
+G_STATIC_ASSERT(sizeof(EventTraceHeader) == 40);
+G_STATIC_ASSERT(sizeof(EventTraceRecord) == 28);
+
+G_DEFINE_QUARK(event-trace-error-quark, event_trace_error)
+
+typedef struct
+{
+    guint n_records;
+    EventTraceRecord records[EVENT_TRACE_BUFFER_RECORDS];
+} EventTraceBuffer;
+
+struct _EventTraceWriter
+{
+    FILE *file;
+    GThread *thread;
+    GAsyncQueue *full_buffers;
+    GAsyncQueue *free_buffers;
+    EventTraceBuffer *buffer;
+    guint n_buffers;
+    guint dropped;
+    gboolean started;
+    uint64_t start_time_usec;
+    uint64_t last_time_usec;
+    WheelClickAngle wheel_click_angle;
+    // Set by the writer thread, read after it is joined
+    int write_errno;
+};
+
+// Pushed to full_buffers to stop the writer thread
+static EventTraceBuffer stop_buffer;
+
+static gpointer writer_thread_func(gpointer data)
+{
+    EventTraceWriter *writer = data;
+    EventTraceBuffer *buffer;
+    while ((buffer = g_async_queue_pop(writer->full_buffers)) != &stop_buffer)
+    {
+        if (writer->write_errno == 0 &&
+            fwrite(buffer->records, sizeof(EventTraceRecord), buffer->n_records, writer->file) != buffer->n_records)
+            writer->write_errno = errno ? errno : EIO;
+        buffer->n_records = 0;
+        g_async_queue_push(writer->free_buffers, buffer);
+    }
+    return NULL;
+}
+
+static gboolean write_header(FILE *file, uint64_t start_time_usec, const WheelClickAngle *wheel_click_angle)
+{
+    EventTraceHeader header = {
+        .magic = EVENT_TRACE_MAGIC,
+        .version = EVENT_TRACE_VERSION,
+        .byte_order = EVENT_TRACE_BYTE_ORDER,
+        .record_size = sizeof(EventTraceRecord),
+        .start_time_usec = start_time_usec,
+        .wheel_click_angle_x = wheel_click_angle->x,
+        .wheel_click_angle_y = wheel_click_angle->y,
+    };
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+EventTraceWriter *event_trace_writer_new(const char *path, const WheelClickAngle *wheel_click_angle, GError **error)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to create %s: %s", path, g_strerror(saved_errno));
+        return NULL;
+    }
+    // Placeholder, the start time is only known once the first event arrives
+    if (!write_header(file, 0, wheel_click_angle))
+    {
+        int saved_errno = errno;
+        g_set_error(error, EVENT_TRACE_ERROR, EVENT_TRACE_ERROR_WRITE,
+                    "Failed to write %s: %s", path, g_strerror(saved_errno));
+        fclose(file);
+        return NULL;
+    }
+
+    EventTraceWriter *writer = g_new0(EventTraceWriter, 1);
+    writer->file = file;
+    writer->wheel_click_angle = *wheel_click_angle;
+    writer->full_buffers = g_async_queue_new();
+    writer->free_buffers = g_async_queue_new_full(g_free);
+    writer->buffer = g_new0(EventTraceBuffer, 1);
+    writer->n_buffers = 1;
+    writer->thread = g_thread_new("event-trace-writer", writer_thread_func, writer);
+    return writer;
+}
+
+static void flush_buffer(EventTraceWriter *writer)
+{
+    if (writer->buffer->n_records == 0)
+        return;
+    g_async_queue_push(writer->full_buffers, writer->buffer);
+    writer->buffer = g_async_queue_try_pop(writer->free_buffers);
+    if (!writer->buffer && writer->n_buffers < EVENT_TRACE_MAX_BUFFERS)
+    {
+        writer->buffer = g_new0(EventTraceBuffer, 1);
+        writer->n_buffers++;
+    }
+}
+
+static EventTraceRecord *next_record(EventTraceWriter *writer)
+{
+    if (writer->buffer && writer->buffer->n_records == EVENT_TRACE_BUFFER_RECORDS)
+        flush_buffer(writer);
+    if (!writer->buffer)
+    {
+        // The disk can't keep up, try to get a buffer back
+        writer->buffer = g_async_queue_try_pop(writer->free_buffers);
+        if (!writer->buffer)
+            return NULL;
+    }
+    return &writer->buffer->records[writer->buffer->n_records++];
+}
+
+void event_trace_writer_append(EventTraceWriter *writer, const EventTraceEvent *event)
+{
+    if (!writer->started)
+    {
+        writer->started = TRUE;
+        writer->start_time_usec = writer->last_time_usec = event->time_usec;
+    }
+
+    // Out of order timestamps are clamped so the deltas stay unsigned
+    uint64_t dt_usec = event->time_usec > writer->last_time_usec ? event->time_usec - writer->last_time_usec : 0;
+    while (dt_usec >= UINT32_MAX)
+    {
+        EventTraceRecord *skip = next_record(writer);
+        if (!skip)
+        {
+            writer->dropped++;
+            return;
+        }
+        *skip = (EventTraceRecord){.dt_usec = UINT32_MAX, .source = EVENT_TRACE_RECORD_SKIP};
+        writer->last_time_usec += UINT32_MAX;
+        dt_usec -= UINT32_MAX;
+    }
+
+    EventTraceRecord *record = next_record(writer);
+    if (!record)
+    {
+        // Dropped events fold their time into the next record
+        writer->dropped++;
+        return;
+    }
+    *record = (EventTraceRecord){
+        .dt_usec = (uint32_t)dt_usec,
+        .source = event->source,
+        .dx = event->dx,
+        .dy = event->dy,
+        .scroll_x = event->scroll_x,
+        .scroll_y = event->scroll_y,
+        .v120_x = (int16_t)CLAMP(event->v120_x, INT16_MIN, INT16_MAX),
+        .v120_y = (int16_t)CLAMP(event->v120_y, INT16_MIN, INT16_MAX),
+    };
+    writer->last_time_usec += dt_usec;
+}
+
+gboolean event_trace_writer_close(EventTraceWriter *writer, GError **error)
+{
+    if (writer->buffer)
+        flush_buffer(writer);
+    g_async_queue_push(writer->full_buffers, &stop_buffer);
+    g_thread_join(writer->thread);
+
+    int write_errno = writer->write_errno;
+    if (write_errno == 0 && (fseek(writer->file, 0, SEEK_SET) != 0 || !write_header(writer->file, writer->start_time_usec, &writer->wheel_click_angle)))
+        write_errno = errno ? errno : EIO;
+    if (fclose(writer->file) != 0 && write_errno == 0)
+        write_errno = errno ? errno : EIO;
+
+    gboolean success = TRUE;
+    if (write_errno != 0)
+    {
+        g_set_error(error, EVENT_TRACE_ERROR, EVENT_TRACE_ERROR_WRITE,
+                    "Failed to write event trace: %s", g_strerror(write_errno));
+        success = FALSE;
+    }
+    else if (writer->dropped > 0)
+    {
+        g_warning("Event trace dropped %u events, the disk could not keep up", writer->dropped);
+    }
+
+    g_free(writer->buffer);
+    g_async_queue_unref(writer->full_buffers);
+    g_async_queue_unref(writer->free_buffers);
+    g_free(writer);
+    return success;
+}
+
+struct _EventTrace
+{
+    GMappedFile *mapped_file;
+    uint64_t start_time_usec;
+    WheelClickAngle wheel_click_angle;
+    const EventTraceRecord *records;
+    gsize n_records;
+};
+
+EventTrace *event_trace_open(const char *path, GError **error)
+{
+    GMappedFile *mapped_file = g_mapped_file_new(path, FALSE, error);
+    if (!mapped_file)
+        return NULL;
+
+    gsize length = g_mapped_file_get_length(mapped_file);
+    const char *contents = g_mapped_file_get_contents(mapped_file);
+    EventTraceHeader header;
+    if (length < sizeof(header))
+    {
+        g_set_error(error, EVENT_TRACE_ERROR, EVENT_TRACE_ERROR_INVALID, "%s is not an event trace", path);
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+    memcpy(&header, contents, sizeof(header));
+    if (memcmp(header.magic, EVENT_TRACE_MAGIC, sizeof(EVENT_TRACE_MAGIC)) != 0 ||
+        header.version != EVENT_TRACE_VERSION ||
+        header.byte_order != EVENT_TRACE_BYTE_ORDER ||
+        header.record_size != sizeof(EventTraceRecord))
+    {
+        g_set_error(error, EVENT_TRACE_ERROR, EVENT_TRACE_ERROR_INVALID,
+                    "%s is not an event trace or was recorded by an incompatible version", path);
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+
+    EventTrace *trace = g_new0(EventTrace, 1);
+    trace->mapped_file = mapped_file;
+    trace->start_time_usec = header.start_time_usec;
+    trace->wheel_click_angle = (WheelClickAngle){header.wheel_click_angle_x, header.wheel_click_angle_y};
+    // A recording that was cut short may end in a partial record, ignore it.
+    // The header is 8 byte aligned in the mapping, so are the records.
+    trace->records = (const EventTraceRecord *)(contents + sizeof(header));
+    trace->n_records = (length - sizeof(header)) / sizeof(EventTraceRecord);
+    return trace;
+}
+
+void event_trace_free(EventTrace *trace)
+{
+    if (trace)
+    {
+        g_mapped_file_unref(trace->mapped_file);
+        g_free(trace);
+    }
+}
+
+gsize event_trace_get_n_records(const EventTrace *trace)
+{
+    return trace->n_records;
+}
+
+const WheelClickAngle *event_trace_get_wheel_click_angle(const EventTrace *trace)
+{
+    return &trace->wheel_click_angle;
+}
+
+void event_trace_iter_init(EventTraceIter *iter, const EventTrace *trace)
+{
+    iter->trace = trace;
+    iter->index = 0;
+    iter->time_usec = trace->start_time_usec;
+}
+
+gboolean event_trace_iter_next(EventTraceIter *iter, EventTraceEvent *event)
+{
+    while (iter->index < iter->trace->n_records)
+    {
+        const EventTraceRecord *record = &iter->trace->records[iter->index++];
+        iter->time_usec += record->dt_usec;
+        if (record->source >= EVENT_TRACE_SOURCE_COUNT)
+            continue;
+        event->time_usec = iter->time_usec;
+        event->source = record->source;
+        event->dx = record->dx;
+        event->dy = record->dy;
+        event->scroll_x = record->scroll_x;
+        event->scroll_y = record->scroll_y;
+        event->v120_x = record->v120_x;
+        event->v120_y = record->v120_y;
+        return TRUE;
+    }
+    return FALSE;
+}
@@ -0,0 +1,91 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+typedef enum
+{
+    EVENT_TRACE_SOURCE_MOTION,
+    EVENT_TRACE_SOURCE_WHEEL,
+    EVENT_TRACE_SOURCE_FINGER,
+    EVENT_TRACE_SOURCE_CONTINUOUS,
+    EVENT_TRACE_SOURCE_COUNT
+} EventTraceSource;
+
+typedef struct
+{
+    uint64_t time_usec;
+    EventTraceSource source;
+    double dx, dy;             // unaccelerated motion
+    double scroll_x, scroll_y; // scroll axes, 0 when the axis is absent
+    double v120_x, v120_y;     // wheel only, 120 per detent
+} EventTraceEvent;
+
+// Degrees a wheel turns per detent, what libinput scales v120 by for the
+// scroll value
+typedef struct
+{
+    double x, y;
+} WheelClickAngle;
+
+// libinput's angle for wheels udev doesn't describe
+#define WHEEL_DEFAULT_CLICK_ANGLE 15.0
+
+#define EVENT_TRACE_ERROR (event_trace_error_quark())
+
+typedef enum
+{
+    EVENT_TRACE_ERROR_INVALID,
+    EVENT_TRACE_ERROR_WRITE,
+} EventTraceError;
+
+GQuark event_trace_error_quark(void);
+
+// Streams events to a trace file. Appending only copies the event into an
+// in-memory buffer, full buffers are written by a background thread, so it
+// is safe to call from the thread dispatching libinput events.
+typedef struct _EventTraceWriter EventTraceWriter;
+
+// The click angle of the recorded wheel is stored with the trace so replays
+// scale its v120 the same way
+EventTraceWriter *event_trace_writer_new(const char *path, const WheelClickAngle *wheel_click_angle, GError **error);
+void event_trace_writer_append(EventTraceWriter *writer, const EventTraceEvent *event);
+// Flushes, closes and frees the writer. Returns FALSE if anything failed to
+// be written during the recording.
+gboolean event_trace_writer_close(EventTraceWriter *writer, GError **error);
+
+// Memory mapped trace file
+typedef struct _EventTrace EventTrace;
+
+EventTrace *event_trace_open(const char *path, GError **error);
+void event_trace_free(EventTrace *trace);
+gsize event_trace_get_n_records(const EventTrace *trace);
+const WheelClickAngle *event_trace_get_wheel_click_angle(const EventTrace *trace);
+
+typedef struct
+{
+    const EventTrace *trace;
+    gsize index;
+    uint64_t time_usec;
+} EventTraceIter;
+
+void event_trace_iter_init(EventTraceIter *iter, const EventTrace *trace);
+gboolean event_trace_iter_next(EventTraceIter *iter, EventTraceEvent *event);
@@ -0,0 +1,100 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "latency-stats.h"
+#include <math.h>
+
+const char *const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {
+    [LATENCY_STAGE_INPUT] = "input",
+    [LATENCY_STAGE_DELIVERY] = "delivery",
+    [LATENCY_STAGE_RENDER] = "render",
+    [LATENCY_STAGE_TOTAL] = "total",
+};
+
+void latency_stats_init(LatencyStats *stats)
+{
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++)
+    {
+        p2_quantile_init(&stats->stages[i].p50, 0.5);
+        p2_quantile_init(&stats->stages[i].p99, 0.99);
+        stats->stages[i].max_usec = NAN;
+    }
+    stats->skipped = 0;
+}
+
+void latency_stats_add(LatencyStats *stats, LatencyStage stage, gint64 latency_usec)
+{
+    // Timestamps from different threads can cross by a few microseconds
+    double value = MAX(latency_usec, 0);
+    LatencyHistogram *histogram = &stats->stages[stage];
+    p2_quantile_add(&histogram->p50, value);
+    p2_quantile_add(&histogram->p99, value);
+    if (!(value <= histogram->max_usec))
+        histogram->max_usec = value;
+}
+
+void latency_stats_skip(LatencyStats *stats, guint64 n_samples)
+{
+    stats->skipped += n_samples;
+}
+
+guint64 latency_stats_get_count(const LatencyStats *stats, LatencyStage stage)
+{
+    return stats->stages[stage].p50.count;
+}
+
+double latency_stats_get_p50(const LatencyStats *stats, LatencyStage stage)
+{
+    return p2_quantile_get(&stats->stages[stage].p50);
+}
+
+double latency_stats_get_p99(const LatencyStats *stats, LatencyStage stage)
+{
+    return p2_quantile_get(&stats->stages[stage].p99);
+}
+
+double latency_stats_get_max(const LatencyStats *stats, LatencyStage stage)
+{
+    return stats->stages[stage].max_usec;
+}
+
+static void append_json_number(GString *json, double value)
+{
+    if (isnan(value))
+        g_string_append(json, "null");
+    else
+        g_string_append_printf(json, "%.0f", value);
+}
+
+char *latency_stats_to_json(const LatencyStats *stats)
+{
+    GString *json = g_string_new("{");
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++)
+    {
+        g_string_append_printf(json, "%s\n  \"%s\": {\"count\": %" G_GUINT64_FORMAT ", \"p50_usec\": ",
+                               i ? "," : "", LATENCY_STAGE_NAMES[i], latency_stats_get_count(stats, i));
+        append_json_number(json, latency_stats_get_p50(stats, i));
+        g_string_append(json, ", \"p99_usec\": ");
+        append_json_number(json, latency_stats_get_p99(stats, i));
+        g_string_append(json, ", \"max_usec\": ");
+        append_json_number(json, latency_stats_get_max(stats, i));
+        g_string_append(json, "}");
+    }
+    g_string_append_printf(json, ",\n  \"skipped\": %" G_GUINT64_FORMAT "\n}\n", stats->skipped);
+    return g_string_free(json, FALSE);
+}
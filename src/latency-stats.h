@@ -0,0 +1,62 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include "p2-quantile.h"
+
+// Where an input event spends its time on the way to the screen. All times
+// are CLOCK_MONOTONIC microseconds, the clock of libinput event times,
+// g_get_monotonic_time() and GdkFrameClock.
+typedef enum
+{
+    LATENCY_STAGE_INPUT,    // kernel timestamp to libinput dequeue
+    LATENCY_STAGE_DELIVERY, // dequeue to the main loop
+    LATENCY_STAGE_RENDER,   // main loop to frame presentation
+    LATENCY_STAGE_TOTAL,    // kernel timestamp to frame presentation
+    LATENCY_STAGE_COUNT
+} LatencyStage;
+
+typedef struct
+{
+    P2Quantile p50;
+    P2Quantile p99;
+    double max_usec;
+} LatencyHistogram;
+
+typedef struct
+{
+    LatencyHistogram stages[LATENCY_STAGE_COUNT];
+    // Samples never shown because no frames were drawn, e.g. while the
+    // window was minimized. They have no render or total latency.
+    guint64 skipped;
+} LatencyStats;
+
+extern const char *const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT];
+
+void latency_stats_init(LatencyStats *stats);
+void latency_stats_add(LatencyStats *stats, LatencyStage stage, gint64 latency_usec);
+void latency_stats_skip(LatencyStats *stats, guint64 n_samples);
+guint64 latency_stats_get_count(const LatencyStats *stats, LatencyStage stage);
+// NAN until the stage has a sample
+double latency_stats_get_p50(const LatencyStats *stats, LatencyStage stage);
+double latency_stats_get_p99(const LatencyStats *stats, LatencyStage stage);
+double latency_stats_get_max(const LatencyStats *stats, LatencyStage stage);
+// One JSON object keyed by stage name, for scripts comparing runs
+char *latency_stats_to_json(const LatencyStats *stats);
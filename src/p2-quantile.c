@@ -0,0 +1,128 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "p2-quantile.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void p2_quantile_init(P2Quantile *quantile, double p)
+{
+    g_assert(p > 0 && p < 1);
+    memset(quantile, 0, sizeof(*quantile));
+    quantile->p = p;
+}
+
+static double parabolic(const P2Quantile *quantile, int i, double d)
+{
+    const double *q = quantile->heights;
+    const double *n = quantile->positions;
+    return q[i] + d / (n[i + 1] - n[i - 1]) *
+                      ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                       (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static double linear(const P2Quantile *quantile, int i, int d)
+{
+    const double *q = quantile->heights;
+    const double *n = quantile->positions;
+    return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+void p2_quantile_add(P2Quantile *quantile, double value)
+{
+    if (isnan(value))
+        return;
+
+    double *q = quantile->heights;
+    double *n = quantile->positions;
+    if (quantile->count < 5)
+    {
+        // The first five samples become the initial markers
+        q[quantile->count++] = value;
+        if (quantile->count == 5)
+        {
+            double p = quantile->p;
+            qsort(q, 5, sizeof(double), compare_doubles);
+            for (int i = 0; i < 5; i++)
+                n[i] = i + 1;
+            memcpy(quantile->desired_positions, (double[]){1, 1 + 2 * p, 1 + 4 * p, 3 + 2 * p, 5}, sizeof(quantile->desired_positions));
+            memcpy(quantile->increments, (double[]){0, p / 2, p, (1 + p) / 2, 1}, sizeof(quantile->increments));
+        }
+        return;
+    }
+
+    // Cell the value falls in, extending the extremes if needed
+    int k;
+    if (value < q[0])
+    {
+        q[0] = value;
+        k = 0;
+    }
+    else if (value >= q[4])
+    {
+        q[4] = value;
+        k = 3;
+    }
+    else
+    {
+        for (k = 0; k < 3 && value >= q[k + 1]; k++)
+            ;
+    }
+
+    for (int i = k + 1; i < 5; i++)
+        n[i]++;
+    for (int i = 0; i < 5; i++)
+        quantile->desired_positions[i] += quantile->increments[i];
+
+    // Move the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++)
+    {
+        double d = quantile->desired_positions[i] - n[i];
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1))
+        {
+            int sign = d > 0 ? 1 : -1;
+            double height = parabolic(quantile, i, sign);
+            if (!(q[i - 1] < height && height < q[i + 1]))
+                height = linear(quantile, i, sign);
+            q[i] = height;
+            n[i] += sign;
+        }
+    }
+    quantile->count++;
+}
+
+double p2_quantile_get(const P2Quantile *quantile)
+{
+    if (quantile->count == 0)
+        return NAN;
+    if (quantile->count >= 5)
+        return quantile->heights[2];
+
+    // Too few samples for markers, use the exact quantile
+    double sorted[5];
+    memcpy(sorted, quantile->heights, quantile->count * sizeof(double));
+    qsort(sorted, quantile->count, sizeof(double), compare_doubles);
+    return sorted[(guint)lround(quantile->p * (quantile->count - 1))];
+}
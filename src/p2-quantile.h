@@ -0,0 +1,39 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+// Streaming quantile estimate with the P² algorithm (Jain & Chlamtac, 1985).
+// Five markers track the minimum, the maximum, the quantile and two points
+// halfway to it, so memory is constant and adding a sample is O(1).
+typedef struct
+{
+    double p;
+    double heights[5];
+    double positions[5];
+    double desired_positions[5];
+    double increments[5];
+    guint64 count;
+} P2Quantile;
+
+void p2_quantile_init(P2Quantile *quantile, double p);
+void p2_quantile_add(P2Quantile *quantile, double value);
+// NAN until the first sample
+double p2_quantile_get(const P2Quantile *quantile);
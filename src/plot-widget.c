@@ -17,7 +17,9 @@
  */
 
 #include "plot-widget.h"
+#include "speed-histogram.h"
 #include <gtk/gtk.h>
+#include <math.h>
 #include <string.h>
 
 #define FONT_SIZE 16
@@ -30,6 +32,10 @@
 #define AXIS_MARKING_PADDING_X 5
 #define AXIS_MARKING_PADDING_Y 5
 #define AXIS_LABEL_PADDING (FONT_SIZE / 2)
+#define HISTOGRAM_HEIGHT_FRACTION 0.25
+// The log-spaced histogram bins are resampled into this many bars across the
+// x axis
+#define HISTOGRAM_COLUMN_COUNT 256
 
 struct _PlotWidget
 {
@@ -44,6 +50,33 @@ struct _PlotWidget
     double plot_margin_left;
     double plot_margin_top;
     Curve *curve;
+    // Samples are coalesced and applied once per frame
+    PlotFrameSamples frame_samples;
+    guint tick_callback_id;
+    PlotFrameSamplesCallback on_frame_samples;
+    gpointer on_frame_samples_user_data;
+    PlotCurveChangedCallback on_curve_changed;
+    gpointer on_curve_changed_user_data;
+    // Speed density drawn behind the curve, the node is rebuilt only when the
+    // rendered bar heights or the plot geometry change
+    SpeedHistogram histogram;
+    P2Quantile speed_quantiles[PLOT_SPEED_QUANTILE_COUNT];
+    guint histogram_serial;
+    guint16 histogram_heights[HISTOGRAM_COLUMN_COUNT];
+    double histogram_x_axis_top_value;
+    double histogram_plot_width;
+    double histogram_plot_height;
+    GskRenderNode *histogram_node;
+    // Background, axes and labels, rebuilt only when what they depend on changes
+    GskRenderNode *static_node;
+    gboolean static_node_dirty;
+    int static_node_width;
+    int static_node_height;
+    int static_node_scale_factor;
+    // Curve and handles, rebuilt only when the curve or the plot geometry
+    // changes. The speed marker is drawn over it every frame.
+    GskRenderNode *curve_node;
+    gboolean curve_node_dirty;
 };
 G_DEFINE_TYPE(PlotWidget, plot_widget, GTK_TYPE_WIDGET)
 
@@ -71,109 +104,315 @@ static void format_axis_label(double value, char *label, size_t size, bool trim_
     }
 }
 
-static void draw_axes(PlotWidget *self, cairo_t *cr, int widget_width, int widget_height)
+static const GdkRGBA BACKGROUND_COLOR = {0.95, 0.95, 0.95, 1};
+static const GdkRGBA AXIS_COLOR = {0, 0, 0, 1};
+static const GdkRGBA CURRENT_X_VALUE_COLOR = {0, 0, 1, 1};
+static const GdkRGBA HISTOGRAM_COLOR = {0.2, 0.4, 0.9, 0.3};
+
+void plot_widget_append_line(GtkSnapshot *snapshot, Point from, Point to, float line_width, const GdkRGBA *color)
+{
+    GskPathBuilder *builder = gsk_path_builder_new();
+    gsk_path_builder_move_to(builder, UNPACK(from));
+    gsk_path_builder_line_to(builder, UNPACK(to));
+    GskPath *path = gsk_path_builder_free_to_path(builder);
+    GskStroke *stroke = gsk_stroke_new(line_width);
+    gtk_snapshot_append_stroke(snapshot, path, stroke, color);
+    gsk_stroke_free(stroke);
+    gsk_path_unref(path);
+}
+
+void plot_widget_append_circle(GtkSnapshot *snapshot, Point center, float radius, const GdkRGBA *color)
+{
+    GskPathBuilder *builder = gsk_path_builder_new();
+    gsk_path_builder_add_circle(builder, &GRAPHENE_POINT_INIT(center.x, center.y), radius);
+    GskPath *path = gsk_path_builder_free_to_path(builder);
+    gtk_snapshot_append_fill(snapshot, path, GSK_FILL_RULE_WINDING, color);
+    gsk_path_unref(path);
+}
+
+static void get_text_extents(PangoLayout *layout, const char *text, double *width, double *height)
+{
+    PangoRectangle ink;
+    pango_layout_set_text(layout, text, -1);
+    pango_layout_get_pixel_extents(layout, &ink, NULL);
+    *width = ink.width;
+    *height = ink.height;
+}
+
+// Draws text with its baseline starting at (x, y)
+static void append_text(GtkSnapshot *snapshot, PangoLayout *layout, const char *text, double x, double y)
+{
+    pango_layout_set_text(layout, text, -1);
+    gtk_snapshot_save(snapshot);
+    gtk_snapshot_translate(snapshot, &GRAPHENE_POINT_INIT(x, y - pango_layout_get_baseline(layout) / (double)PANGO_SCALE));
+    gtk_snapshot_append_layout(snapshot, layout, &AXIS_COLOR);
+    gtk_snapshot_restore(snapshot);
+}
+
+// Axis lines and markings are as wide as a default Cairo stroke
+#define AXIS_LINE_WIDTH 2
+
+static void append_axis_rect(GtkSnapshot *snapshot, double x, double y, double width, double height)
+{
+    gtk_snapshot_append_color(snapshot, &AXIS_COLOR, &GRAPHENE_RECT_INIT(x, y, width, height));
+}
+
+static PangoLayout *create_axis_layout(PlotWidget *self)
+{
+    PangoLayout *layout = gtk_widget_create_pango_layout(GTK_WIDGET(self), NULL);
+    PangoFontDescription *font = pango_font_description_new();
+    pango_font_description_set_absolute_size(font, FONT_SIZE * PANGO_SCALE);
+    pango_layout_set_font_description(layout, font);
+    pango_font_description_free(font);
+    return layout;
+}
+
+static void snapshot_axes(PlotWidget *self, GtkSnapshot *snapshot, int widget_width, int widget_height)
 {
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_font_size(cr, FONT_SIZE);
+    PangoLayout *layout = create_axis_layout(self);
     // Calculate text extents for axis labels and top values
-    cairo_text_extents_t x_label_extents, y_label_extents, x_top_value_extents, y_top_value_extents;
-    cairo_text_extents(cr, self->x_axis_label, &x_label_extents);
-    cairo_text_extents(cr, self->y_axis_label, &y_label_extents);
+    double x_label_width, x_label_height, y_label_width, y_label_height;
+    double x_top_value_width, x_top_value_height, y_top_value_width, y_top_value_height;
+    get_text_extents(layout, self->x_axis_label, &x_label_width, &x_label_height);
+    get_text_extents(layout, self->y_axis_label, &y_label_width, &y_label_height);
     char top_value_label[8];
     format_axis_label(self->x_axis_top_value, top_value_label, sizeof(top_value_label), false);
-    cairo_text_extents(cr, top_value_label, &x_top_value_extents);
+    get_text_extents(layout, top_value_label, &x_top_value_width, &x_top_value_height);
     format_axis_label(self->y_axis_top_value, top_value_label, sizeof(top_value_label), false);
-    cairo_text_extents(cr, top_value_label, &y_top_value_extents);
+    get_text_extents(layout, top_value_label, &y_top_value_width, &y_top_value_height);
 
     // Calculate plot dimensions
-    self->plot_margin_left = WIDGET_PADDING_LEFT + y_label_extents.height +
-                             AXIS_LABEL_PADDING + y_top_value_extents.width +
+    self->plot_margin_left = WIDGET_PADDING_LEFT + y_label_height +
+                             AXIS_LABEL_PADDING + y_top_value_width +
                              AXIS_MARKING_PADDING_X + AXIS_MARKING_LENGTH;
-    double plot_margin_bottom = WIDGET_PADDING_BOTTOM + x_label_extents.height +
-                                AXIS_LABEL_PADDING + x_top_value_extents.height +
+    double plot_margin_bottom = WIDGET_PADDING_BOTTOM + x_label_height +
+                                AXIS_LABEL_PADDING + x_top_value_height +
                                 AXIS_MARKING_PADDING_Y + AXIS_MARKING_LENGTH;
-    double plot_margin_right = WIDGET_PADDING_RIGHT + x_top_value_extents.width / 2;
-    self->plot_margin_top = WIDGET_PADDING_TOP + y_top_value_extents.height / 2;
+    double plot_margin_right = WIDGET_PADDING_RIGHT + x_top_value_width / 2;
+    self->plot_margin_top = WIDGET_PADDING_TOP + y_top_value_height / 2;
     self->plot_width = widget_width - (self->plot_margin_left + plot_margin_right);
     self->plot_height = widget_height - (self->plot_margin_top + plot_margin_bottom);
 
     // Draw X-axis label
-    cairo_move_to(cr,
-                  self->plot_margin_left + self->plot_width / 2 - x_label_extents.width / 2,
-                  widget_height - WIDGET_PADDING_BOTTOM);
-    cairo_show_text(cr, self->x_axis_label);
+    append_text(snapshot, layout, self->x_axis_label,
+                self->plot_margin_left + self->plot_width / 2 - x_label_width / 2,
+                widget_height - WIDGET_PADDING_BOTTOM);
 
     // Draw Y-axis label
-    cairo_save(cr);
-    cairo_rotate(cr, -G_PI / 2);
-    cairo_move_to(cr, -(self->plot_margin_top + self->plot_height / 2 + y_label_extents.width / 2), WIDGET_PADDING_LEFT + y_label_extents.height);
-    cairo_show_text(cr, self->y_axis_label);
-    cairo_restore(cr);
-
-    cairo_save(cr);
-    cairo_translate(cr, self->plot_margin_left, self->plot_margin_top);
+    gtk_snapshot_save(snapshot);
+    gtk_snapshot_rotate(snapshot, -90);
+    append_text(snapshot, layout, self->y_axis_label,
+                -(self->plot_margin_top + self->plot_height / 2 + y_label_width / 2),
+                WIDGET_PADDING_LEFT + y_label_height);
+    gtk_snapshot_restore(snapshot);
+
+    gtk_snapshot_save(snapshot);
+    gtk_snapshot_translate(snapshot, &GRAPHENE_POINT_INIT(self->plot_margin_left, self->plot_margin_top));
     // Draw X-axis markings
     for (int i = 0; i <= AXIS_MARKING_COUNT; i++)
     {
         double x = i * self->plot_width / (double)AXIS_MARKING_COUNT;
-        cairo_move_to(cr, x, self->plot_height);
-        cairo_line_to(cr, x, self->plot_height + AXIS_MARKING_LENGTH);
-        cairo_stroke(cr);
+        append_axis_rect(snapshot, x - AXIS_LINE_WIDTH / 2.0, self->plot_height, AXIS_LINE_WIDTH, AXIS_MARKING_LENGTH);
 
         double value = i * self->x_axis_top_value / AXIS_MARKING_COUNT;
         char label[8];
         format_axis_label(value, label, sizeof(label), true);
 
-        cairo_text_extents_t extents;
-        cairo_text_extents(cr, label, &extents);
-        cairo_move_to(cr, x - extents.width / 2, self->plot_height + AXIS_MARKING_LENGTH + AXIS_MARKING_PADDING_Y + extents.height);
-        cairo_show_text(cr, label);
+        double width, height;
+        get_text_extents(layout, label, &width, &height);
+        append_text(snapshot, layout, label, x - width / 2, self->plot_height + AXIS_MARKING_LENGTH + AXIS_MARKING_PADDING_Y + height);
     }
 
     // Draw Y-axis markings
     for (int i = 0; i <= AXIS_MARKING_COUNT; i++)
     {
         double y = i * self->plot_height / (double)AXIS_MARKING_COUNT;
-        cairo_move_to(cr, -AXIS_MARKING_LENGTH, y);
-        cairo_line_to(cr, 0, y);
-        cairo_stroke(cr);
+        append_axis_rect(snapshot, -AXIS_MARKING_LENGTH, y - AXIS_LINE_WIDTH / 2.0, AXIS_MARKING_LENGTH, AXIS_LINE_WIDTH);
 
         double value = self->y_axis_top_value - i * self->y_axis_top_value / AXIS_MARKING_COUNT;
         char label[8];
         format_axis_label(value, label, sizeof(label), true);
 
-        cairo_text_extents_t extents;
-        cairo_text_extents(cr, label, &extents);
-        cairo_move_to(cr, -AXIS_MARKING_LENGTH - extents.width - AXIS_MARKING_PADDING_X, y + extents.height / 2);
-        cairo_show_text(cr, label);
+        double width, height;
+        get_text_extents(layout, label, &width, &height);
+        append_text(snapshot, layout, label, -AXIS_MARKING_LENGTH - width - AXIS_MARKING_PADDING_X, y + height / 2);
     }
 
     // Draw X-axis
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_move_to(cr, 0, self->plot_height);
-    cairo_line_to(cr, self->plot_width, self->plot_height);
-    cairo_stroke(cr);
+    append_axis_rect(snapshot, 0, self->plot_height - AXIS_LINE_WIDTH / 2.0, self->plot_width, AXIS_LINE_WIDTH);
 
     // Draw Y-axis
-    cairo_move_to(cr, 0, 0);
-    cairo_line_to(cr, 0, self->plot_height);
-    cairo_stroke(cr);
+    append_axis_rect(snapshot, -AXIS_LINE_WIDTH / 2.0, 0, AXIS_LINE_WIDTH, self->plot_height);
 
-    cairo_restore(cr);
+    gtk_snapshot_restore(snapshot);
+    g_object_unref(layout);
 }
 
-static void draw_current_x_value(PlotWidget *self, cairo_t *cr)
+static void snapshot_current_x_value(PlotWidget *self, GtkSnapshot *snapshot)
 {
     g_assert(self->curve);
     double x_value = self->current_x_value / self->x_axis_top_value;
     double y_value = plot_widget_get_y_value(self, x_value);
     Point current_value_screen = plot_widget_to_screen(self, (Point){x_value, y_value});
-    cairo_set_source_rgb(cr, 0, 0, 1);
-    cairo_move_to(cr, UNPACK(plot_widget_to_screen(self, (Point){x_value, 0})));
-    cairo_line_to(cr, UNPACK(current_value_screen));
-    cairo_stroke(cr);
-    cairo_arc(cr, UNPACK(current_value_screen), CONTROL_POINT_RADIUS, 0, 2 * G_PI);
-    cairo_fill(cr);
+    plot_widget_append_line(snapshot, plot_widget_to_screen(self, (Point){x_value, 0}), current_value_screen,
+                            AXIS_LINE_WIDTH, &CURRENT_X_VALUE_COLOR);
+    plot_widget_append_circle(snapshot, current_value_screen, CONTROL_POINT_RADIUS, &CURRENT_X_VALUE_COLOR);
+}
+
+// Returns TRUE when the bar heights differ from the cached node
+static gboolean update_histogram_heights(PlotWidget *self)
+{
+    // Each bin's count is spread evenly over the columns it overlaps, so the
+    // bars show a density whatever the bin and column widths
+    double column_width = self->x_axis_top_value / HISTOGRAM_COLUMN_COUNT;
+    double densities[HISTOGRAM_COLUMN_COUNT] = {0};
+    for (int i = 0; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+    {
+        double start = speed_histogram_get_bin_start(i);
+        if (start >= self->x_axis_top_value)
+            break;
+        double end = speed_histogram_get_bin_end(i);
+        if (self->histogram.bins[i] == 0 || isinf(end))
+            continue;
+        double density = self->histogram.bins[i] / (end - start);
+        for (int column = (int)(start / column_width); column < HISTOGRAM_COLUMN_COUNT; column++)
+        {
+            double overlap = fmin(end, (column + 1) * column_width) - fmax(start, column * column_width);
+            if (overlap <= 0)
+                break;
+            densities[column] += density * overlap;
+        }
+    }
+
+    double max_density = 0;
+    for (int i = 0; i < HISTOGRAM_COLUMN_COUNT; i++)
+        max_density = fmax(max_density, densities[i]);
+
+    gboolean changed = FALSE;
+    double max_height = self->plot_height * HISTOGRAM_HEIGHT_FRACTION;
+    for (int i = 0; i < HISTOGRAM_COLUMN_COUNT; i++)
+    {
+        guint16 height = 0;
+        if (max_density > 0)
+            height = (guint16)round(max_height * densities[i] / max_density);
+        changed = changed || height != self->histogram_heights[i];
+        self->histogram_heights[i] = height;
+    }
+    return changed;
+}
+
+static GskRenderNode *create_histogram_node(PlotWidget *self)
+{
+    GtkSnapshot *snapshot = gtk_snapshot_new();
+    gtk_snapshot_push_clip(snapshot, &GRAPHENE_RECT_INIT(self->plot_margin_left, self->plot_margin_top,
+                                                         self->plot_width, self->plot_height));
+
+    double column_width = self->plot_width / HISTOGRAM_COLUMN_COUNT;
+    double base = self->plot_margin_top + self->plot_height;
+    GskPathBuilder *builder = gsk_path_builder_new();
+    gsk_path_builder_move_to(builder, self->plot_margin_left, base);
+    for (int i = 0; i < HISTOGRAM_COLUMN_COUNT; i++)
+    {
+        double left = self->plot_margin_left + i * column_width;
+        gsk_path_builder_line_to(builder, left, base - self->histogram_heights[i]);
+        gsk_path_builder_line_to(builder, left + column_width, base - self->histogram_heights[i]);
+    }
+    gsk_path_builder_line_to(builder, self->plot_margin_left + self->plot_width, base);
+    gsk_path_builder_close(builder);
+    GskPath *path = gsk_path_builder_free_to_path(builder);
+    gtk_snapshot_append_fill(snapshot, path, GSK_FILL_RULE_WINDING, &HISTOGRAM_COLOR);
+    gsk_path_unref(path);
+
+    gtk_snapshot_pop(snapshot);
+    return gtk_snapshot_free_to_node(snapshot);
+}
+
+static void snapshot_histogram(PlotWidget *self, GtkSnapshot *snapshot)
+{
+    if (self->histogram.total == 0)
+        return;
+
+    gboolean geometry_changed = self->histogram_x_axis_top_value != self->x_axis_top_value ||
+                                self->histogram_plot_width != self->plot_width ||
+                                self->histogram_plot_height != self->plot_height;
+    gboolean heights_changed = FALSE;
+    if (geometry_changed || self->histogram_serial != self->histogram.serial)
+    {
+        heights_changed = update_histogram_heights(self);
+        self->histogram_serial = self->histogram.serial;
+    }
+
+    if (!self->histogram_node || geometry_changed || heights_changed)
+    {
+        g_clear_pointer(&self->histogram_node, gsk_render_node_unref);
+        self->histogram_node = create_histogram_node(self);
+        self->histogram_x_axis_top_value = self->x_axis_top_value;
+        self->histogram_plot_width = self->plot_width;
+        self->histogram_plot_height = self->plot_height;
+    }
+
+    if (self->histogram_node)
+        gtk_snapshot_append_node(snapshot, self->histogram_node);
+}
+
+static GskRenderNode *create_static_node(PlotWidget *self, int widget_width, int widget_height)
+{
+    GtkSnapshot *snapshot = gtk_snapshot_new();
+    gtk_snapshot_append_color(snapshot, &BACKGROUND_COLOR, &GRAPHENE_RECT_INIT(0, 0, widget_width, widget_height));
+
+    // Also computes the plot geometry used by the dynamic layer
+    snapshot_axes(self, snapshot, widget_width, widget_height);
+
+    return gtk_snapshot_free_to_node(snapshot);
+}
+
+static void snapshot_static_layer(PlotWidget *self, GtkSnapshot *snapshot, int widget_width, int widget_height)
+{
+    int scale_factor = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+    if (!self->static_node || self->static_node_dirty ||
+        self->static_node_width != widget_width ||
+        self->static_node_height != widget_height ||
+        self->static_node_scale_factor != scale_factor)
+    {
+        g_clear_pointer(&self->static_node, gsk_render_node_unref);
+        self->static_node = create_static_node(self, widget_width, widget_height);
+        self->static_node_dirty = FALSE;
+        self->static_node_width = widget_width;
+        self->static_node_height = widget_height;
+        self->static_node_scale_factor = scale_factor;
+        // The plot geometry may have moved under the curve
+        self->curve_node_dirty = TRUE;
+    }
+
+    if (self->static_node)
+        gtk_snapshot_append_node(snapshot, self->static_node);
+}
+
+static void invalidate_static_layer(PlotWidget *self)
+{
+    self->static_node_dirty = TRUE;
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
+
+static void snapshot_curve_layer(PlotWidget *self, GtkSnapshot *snapshot)
+{
+    if (!self->curve_node || self->curve_node_dirty)
+    {
+        g_clear_pointer(&self->curve_node, gsk_render_node_unref);
+        GtkSnapshot *curve_snapshot = gtk_snapshot_new();
+        self->curve->snapshot(self, curve_snapshot);
+        self->curve_node = gtk_snapshot_free_to_node(curve_snapshot);
+        self->curve_node_dirty = FALSE;
+    }
+
+    if (self->curve_node)
+        gtk_snapshot_append_node(snapshot, self->curve_node);
+}
+
+static void invalidate_curve_layer(PlotWidget *self)
+{
+    self->curve_node_dirty = TRUE;
+    gtk_widget_queue_draw(GTK_WIDGET(self));
 }
 
 static void on_snapshot(GtkWidget *widget, GtkSnapshot *snapshot)
@@ -181,21 +420,15 @@ static void on_snapshot(GtkWidget *widget, GtkSnapshot *snapshot)
     PlotWidget *self = PLOT_WIDGET(widget);
     int widget_width = gtk_widget_get_width(widget);
     int widget_height = gtk_widget_get_height(widget);
-    // Create a cairo context from the snapshot
-    cairo_t *cr = gtk_snapshot_append_cairo(snapshot, &GRAPHENE_RECT_INIT(0, 0, widget_width, widget_height));
 
-    // background color
-    cairo_set_source_rgb(cr, 0.95, 0.95, 0.95);
-    cairo_paint(cr);
+    snapshot_static_layer(self, snapshot, widget_width, widget_height);
+    snapshot_histogram(self, snapshot);
 
-    draw_axes(self, cr, widget_width, widget_height);
-    if (self->curve && self->curve->draw)
+    if (self->curve && self->curve->snapshot)
     {
-        self->curve->draw(self, cr);
-        draw_current_x_value(self, cr);
+        snapshot_curve_layer(self, snapshot);
+        snapshot_current_x_value(self, snapshot);
     }
-
-    cairo_destroy(cr);
 }
 
 static gboolean on_button_press(GtkGestureClick *gesture, int n_press, double x, double y, gpointer user_data)
@@ -227,22 +460,119 @@ static void on_motion_notify(GtkEventControllerMotion *controller, double x, dou
 
 void plot_widget_set_x_axis_top_value(PlotWidget *self, double value)
 {
+    if (self->x_axis_top_value == value)
+        return;
     self->x_axis_top_value = value;
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    invalidate_static_layer(self);
 }
 
 void plot_widget_set_y_axis_top_value(PlotWidget *self, double value)
 {
+    if (self->y_axis_top_value == value)
+        return;
     self->y_axis_top_value = value;
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    invalidate_static_layer(self);
 }
 
 void plot_widget_set_current_x_value(PlotWidget *self, double value)
 {
+    if (self->current_x_value == value)
+        return;
     self->current_x_value = value;
+    // Only the marker is rebuilt, the other layers reuse their cached nodes
     gtk_widget_queue_draw(GTK_WIDGET(self));
 }
 
+static gint64 get_presentation_time(GdkFrameClock *frame_clock)
+{
+    // The actual presentation time is only known after the frame was shown,
+    // and not by every backend. Fall back to when the frame started.
+    GdkFrameTimings *timings = gdk_frame_clock_get_current_timings(frame_clock);
+    gint64 presentation_time = timings ? gdk_frame_timings_get_predicted_presentation_time(timings) : 0;
+    return presentation_time ? presentation_time : gdk_frame_clock_get_frame_time(frame_clock);
+}
+
+gboolean plot_widget_flush_frame_samples(PlotWidget *self, gint64 presentation_time_usec)
+{
+    if (self->frame_samples.count == 0)
+        return FALSE;
+
+    PlotFrameSamples samples = self->frame_samples;
+    self->frame_samples = (PlotFrameSamples){0};
+    samples.presentation_time_usec = presentation_time_usec;
+    if (self->on_frame_samples)
+        self->on_frame_samples(self, &samples, self->on_frame_samples_user_data);
+    else
+        plot_widget_set_current_x_value(self, samples.last);
+    return TRUE;
+}
+
+static gboolean on_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+    (void)user_data;
+    PlotWidget *self = PLOT_WIDGET(widget);
+    if (!plot_widget_flush_frame_samples(self, get_presentation_time(frame_clock)))
+    {
+        // Nothing arrived during the last frame, stop ticking until the next sample
+        self->tick_callback_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void plot_widget_add_x_sample(PlotWidget *self, double value)
+{
+    PlotFrameSamples *samples = &self->frame_samples;
+    samples->last = value;
+    if (samples->count == 0 || value > samples->max)
+        samples->max = value;
+    samples->count++;
+    speed_histogram_add(&self->histogram, value);
+    for (int i = 0; i < PLOT_SPEED_QUANTILE_COUNT; i++)
+        p2_quantile_add(&self->speed_quantiles[i], value);
+    if (self->tick_callback_id == 0)
+        self->tick_callback_id = gtk_widget_add_tick_callback(GTK_WIDGET(self), on_tick, NULL, NULL);
+}
+
+void plot_widget_discard_x_samples(PlotWidget *self)
+{
+    self->frame_samples = (PlotFrameSamples){0};
+}
+
+static void init_speed_quantiles(PlotWidget *self)
+{
+    static const double percentiles[PLOT_SPEED_QUANTILE_COUNT] = {0.5, 0.95, 0.99, 0.999};
+    for (int i = 0; i < PLOT_SPEED_QUANTILE_COUNT; i++)
+        p2_quantile_init(&self->speed_quantiles[i], percentiles[i]);
+}
+
+void plot_widget_clear_histogram(PlotWidget *self)
+{
+    // Keep the serial increasing so the cached node is never mistaken as current
+    guint serial = self->histogram.serial;
+    speed_histogram_init(&self->histogram);
+    self->histogram.serial = serial + 1;
+    init_speed_quantiles(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
+
+const SpeedHistogram *plot_widget_get_histogram(PlotWidget *self)
+{
+    return &self->histogram;
+}
+
+double plot_widget_get_speed_quantile(PlotWidget *self, PlotSpeedQuantile quantile)
+{
+    g_return_val_if_fail(quantile < PLOT_SPEED_QUANTILE_COUNT, NAN);
+    return p2_quantile_get(&self->speed_quantiles[quantile]);
+}
+
+void plot_widget_set_frame_samples_callback(PlotWidget *self, PlotFrameSamplesCallback callback, gpointer user_data)
+{
+    self->on_frame_samples = callback;
+    self->on_frame_samples_user_data = user_data;
+}
+
 double plot_widget_get_x_axis_top_value(PlotWidget *self)
 {
     return self->x_axis_top_value;
@@ -262,20 +592,20 @@ void plot_widget_set_x_axis_label(PlotWidget *self, const char *label)
 {
     g_free(self->x_axis_label);
     self->x_axis_label = g_strdup(label);
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    invalidate_static_layer(self);
 }
 
 void plot_widget_set_y_axis_label(PlotWidget *self, const char *label)
 {
     g_free(self->y_axis_label);
     self->y_axis_label = g_strdup(label);
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    invalidate_static_layer(self);
 }
 
 void plot_widget_set_curve(PlotWidget *self, Curve *curve)
 {
     self->curve = curve;
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    invalidate_curve_layer(self);
 }
 
 Curve *plot_widget_get_curve(PlotWidget *self)
@@ -283,17 +613,54 @@ Curve *plot_widget_get_curve(PlotWidget *self)
     return self->curve;
 }
 
+void plot_widget_curve_changed(PlotWidget *self)
+{
+    invalidate_curve_layer(self);
+    if (self->on_curve_changed)
+        self->on_curve_changed(self, self->on_curve_changed_user_data);
+}
+
+void plot_widget_set_curve_changed_callback(PlotWidget *self, PlotCurveChangedCallback callback, gpointer user_data)
+{
+    self->on_curve_changed = callback;
+    self->on_curve_changed_user_data = user_data;
+}
+
 double plot_widget_get_y_value(PlotWidget *self, double x)
 {
     return self->curve->get_y_value(self, x);
 }
 
+void plot_widget_get_y_values(PlotWidget *self, const double *x_values, double *y_values, size_t n)
+{
+    if (self->curve->get_y_values)
+    {
+        self->curve->get_y_values(self, x_values, y_values, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        y_values[i] = self->curve->get_y_value(self, x_values[i]);
+}
+
 static void plot_widget_init(PlotWidget *self)
 {
     self->curve = NULL;
     self->x_axis_top_value = 1;
     self->y_axis_top_value = 1;
     self->current_x_value = 0;
+    self->frame_samples = (PlotFrameSamples){0};
+    self->tick_callback_id = 0;
+    self->on_frame_samples = NULL;
+    self->on_frame_samples_user_data = NULL;
+    self->on_curve_changed = NULL;
+    self->on_curve_changed_user_data = NULL;
+    speed_histogram_init(&self->histogram);
+    init_speed_quantiles(self);
+    self->histogram_node = NULL;
+    self->static_node = NULL;
+    self->static_node_dirty = TRUE;
+    self->curve_node = NULL;
+    self->curve_node_dirty = TRUE;
     self->x_axis_label = g_strdup("X Axis");
     self->y_axis_label = g_strdup("Y Axis");
 
@@ -315,6 +682,9 @@ static void plot_widget_finalize(GObject *object)
     PlotWidget *self = PLOT_WIDGET(object);
     g_free(self->x_axis_label);
     g_free(self->y_axis_label);
+    g_clear_pointer(&self->histogram_node, gsk_render_node_unref);
+    g_clear_pointer(&self->static_node, gsk_render_node_unref);
+    g_clear_pointer(&self->curve_node, gsk_render_node_unref);
     G_OBJECT_CLASS(plot_widget_parent_class)->finalize(object);
 }
 
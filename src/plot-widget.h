@@ -19,6 +19,8 @@
 #pragma once
 
 #include <gtk/gtk.h>
+#include "speed-histogram.h"
+#include "p2-quantile.h"
 
 G_BEGIN_DECLS
 
@@ -35,18 +37,55 @@ G_DECLARE_FINAL_TYPE(PlotWidget, plot_widget, PLOT, WIDGET, GtkDrawingArea)
 
 typedef struct
 {
-    void (*draw)(PlotWidget *self, cairo_t *cr);
+    void (*snapshot)(PlotWidget *self, GtkSnapshot *snapshot);
     double (*get_y_value)(PlotWidget *self, double x_value);
+    // Optional, evaluates n x values at once
+    void (*get_y_values)(PlotWidget *self, const double *x_values, double *y_values, size_t n);
     void (*on_button_press)(PlotWidget *self, double x, double y);
     void (*on_button_release)(PlotWidget *self, double x, double y);
     void (*on_motion_notify)(PlotWidget *self, double x, double y);
     void *user_data;
 } Curve;
 
+// Speed samples gathered between two frames
+typedef struct
+{
+    double last;
+    double max;
+    guint count;
+    // When the frame showing them is expected on screen, in the
+    // g_get_monotonic_time() clock
+    gint64 presentation_time_usec;
+} PlotFrameSamples;
+
+// Speed percentiles tracked over every sample since the histogram was cleared
+typedef enum
+{
+    PLOT_SPEED_QUANTILE_P50,
+    PLOT_SPEED_QUANTILE_P95,
+    PLOT_SPEED_QUANTILE_P99,
+    PLOT_SPEED_QUANTILE_P999,
+    PLOT_SPEED_QUANTILE_COUNT
+} PlotSpeedQuantile;
+
+typedef void (*PlotFrameSamplesCallback)(PlotWidget *self, const PlotFrameSamples *samples, gpointer user_data);
+typedef void (*PlotCurveChangedCallback)(PlotWidget *self, gpointer user_data);
+
 GtkWidget *plot_widget_new(void);
 void plot_widget_set_x_axis_top_value(PlotWidget *self, double value);
 void plot_widget_set_y_axis_top_value(PlotWidget *self, double value);
 void plot_widget_set_current_x_value(PlotWidget *self, double value);
+void plot_widget_add_x_sample(PlotWidget *self, double value);
+void plot_widget_discard_x_samples(PlotWidget *self);
+// Hands the samples added since the last frame to the frame samples callback,
+// what the tick callback does every frame. Returns FALSE when there were none.
+gboolean plot_widget_flush_frame_samples(PlotWidget *self, gint64 presentation_time_usec);
+// Also resets the speed quantiles
+void plot_widget_clear_histogram(PlotWidget *self);
+const SpeedHistogram *plot_widget_get_histogram(PlotWidget *self);
+// NAN before the first sample
+double plot_widget_get_speed_quantile(PlotWidget *self, PlotSpeedQuantile quantile);
+void plot_widget_set_frame_samples_callback(PlotWidget *self, PlotFrameSamplesCallback callback, gpointer user_data);
 
 double plot_widget_get_x_axis_top_value(PlotWidget *self);
 double plot_widget_get_y_axis_top_value(PlotWidget *self);
@@ -57,10 +96,17 @@ void plot_widget_set_y_axis_label(PlotWidget *self, const char *label);
 
 void plot_widget_set_curve(PlotWidget *self, Curve *curve);
 Curve *plot_widget_get_curve(PlotWidget *self);
+// Called by curves after their shape changed
+void plot_widget_curve_changed(PlotWidget *self);
+void plot_widget_set_curve_changed_callback(PlotWidget *self, PlotCurveChangedCallback callback, gpointer user_data);
 
 Point plot_widget_to_screen(PlotWidget *self, Point point);
 Point plot_widget_from_screen(PlotWidget *self, Point point);
+// Drawing helpers for curves, in screen coordinates
+void plot_widget_append_line(GtkSnapshot *snapshot, Point from, Point to, float line_width, const GdkRGBA *color);
+void plot_widget_append_circle(GtkSnapshot *snapshot, Point center, float radius, const GdkRGBA *color);
 
 double plot_widget_get_y_value(PlotWidget *self, double x);
+void plot_widget_get_y_values(PlotWidget *self, const double *x_values, double *y_values, size_t n);
 
 G_END_DECLS
@@ -0,0 +1,155 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "pointer-tracker.h"
+#include <math.h>
+#include <string.h>
+
+// Same constants as libinput's filter.c
+#define MOTION_TIMEOUT_USEC 1000000
+#define MAX_VELOCITY_DIFF (1.0 / 1000) // 1 unit/ms in units/us
+
+enum
+{
+    DIRECTION_N = 1 << 0,
+    DIRECTION_NE = 1 << 1,
+    DIRECTION_E = 1 << 2,
+    DIRECTION_SE = 1 << 3,
+    DIRECTION_S = 1 << 4,
+    DIRECTION_SW = 1 << 5,
+    DIRECTION_W = 1 << 6,
+    DIRECTION_NW = 1 << 7,
+    DIRECTION_UNDEFINED = 0xff,
+};
+
+static guint32 get_direction(double dx, double dy)
+{
+    // Small deltas are too noisy for an angle, mark the whole half plane
+    if (fabs(dx) < 2.0 && fabs(dy) < 2.0)
+    {
+        if (dx > 0.0 && dy > 0.0)
+            return DIRECTION_S | DIRECTION_SE | DIRECTION_E;
+        if (dx > 0.0 && dy < 0.0)
+            return DIRECTION_N | DIRECTION_NE | DIRECTION_E;
+        if (dx < 0.0 && dy > 0.0)
+            return DIRECTION_S | DIRECTION_SW | DIRECTION_W;
+        if (dx < 0.0 && dy < 0.0)
+            return DIRECTION_N | DIRECTION_NW | DIRECTION_W;
+        if (dx > 0.0)
+            return DIRECTION_NE | DIRECTION_E | DIRECTION_SE;
+        if (dx < 0.0)
+            return DIRECTION_NW | DIRECTION_W | DIRECTION_SW;
+        if (dy > 0.0)
+            return DIRECTION_SE | DIRECTION_S | DIRECTION_SW;
+        if (dy < 0.0)
+            return DIRECTION_NE | DIRECTION_N | DIRECTION_NW;
+        return DIRECTION_UNDEFINED;
+    }
+
+    // Angle in [0, 8) octants where 0 is north, mark one or two close enough octants
+    double r = atan2(dy, dx);
+    r = fmod(r + 2.5 * G_PI, 2 * G_PI);
+    r *= 4 / G_PI;
+    int d1 = (int)(r + 0.9) % 8;
+    int d2 = (int)(r + 0.1) % 8;
+    return (1u << d1) | (1u << d2);
+}
+
+static const PointerTrackerEntry *get_entry_by_offset(const PointerTracker *tracker, guint offset)
+{
+    return &tracker->entries[(tracker->current + POINTER_TRACKER_COUNT - offset) % POINTER_TRACKER_COUNT];
+}
+
+static double get_entry_velocity(const PointerTrackerEntry *entry, uint64_t time_usec)
+{
+    uint64_t dt_usec = time_usec - entry->time_usec + 1;
+    return sqrt(entry->dx * entry->dx + entry->dy * entry->dy) / (double)dt_usec; // units/us
+}
+
+void pointer_tracker_init(PointerTracker *tracker)
+{
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+void pointer_tracker_feed(PointerTracker *tracker, double dx, double dy, uint64_t time_usec)
+{
+    for (int i = 0; i < POINTER_TRACKER_COUNT; i++)
+    {
+        tracker->entries[i].dx += dx;
+        tracker->entries[i].dy += dy;
+    }
+
+    tracker->current = (tracker->current + 1) % POINTER_TRACKER_COUNT;
+    PointerTrackerEntry *entry = &tracker->entries[tracker->current];
+    entry->dx = 0;
+    entry->dy = 0;
+    entry->time_usec = time_usec;
+    entry->direction = get_direction(dx, dy);
+}
+
+// Returns the velocity in units/ms
+double pointer_tracker_get_velocity(const PointerTracker *tracker, uint64_t time_usec)
+{
+    double result = 0.0;
+    double initial_velocity = 0.0;
+    guint32 direction = get_entry_by_offset(tracker, 0)->direction;
+
+    // Find the least recent entry within the time limit, velocity difference
+    // and direction thresholds
+    for (guint offset = 1; offset < POINTER_TRACKER_COUNT; offset++)
+    {
+        const PointerTrackerEntry *entry = get_entry_by_offset(tracker, offset);
+
+        // Not filled yet
+        if (entry->time_usec == 0 || entry->time_usec > time_usec)
+            break;
+
+        if (time_usec - entry->time_usec > MOTION_TIMEOUT_USEC)
+        {
+            // First motion after a pause, guess from the motion alone
+            if (offset == 1)
+                result = get_entry_velocity(entry, entry->time_usec + MOTION_TIMEOUT_USEC);
+            break;
+        }
+
+        double velocity = get_entry_velocity(entry, time_usec);
+
+        direction &= entry->direction;
+        if (direction == 0)
+        {
+            // First motion after a direction change
+            if (offset == 1)
+                result = velocity;
+            break;
+        }
+
+        // Always average over at least two entries
+        if (initial_velocity == 0.0 || offset <= 2)
+        {
+            result = initial_velocity = velocity;
+        }
+        else
+        {
+            if (fabs(initial_velocity - velocity) > MAX_VELOCITY_DIFF)
+                break;
+            result = velocity;
+        }
+    }
+
+    return result * 1000;
+}
@@ -0,0 +1,45 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+// Number of motion trackers libinput keeps per device
+#define POINTER_TRACKER_COUNT 16
+
+typedef struct
+{
+    double dx, dy; // motion accumulated since time_usec
+    uint64_t time_usec;
+    guint32 direction;
+} PointerTrackerEntry;
+
+// Reimplementation of libinput's pointer trackers, the velocity estimate its
+// acceleration filters, including the custom profile, are fed with. Fixed size,
+// feeding and querying never allocate.
+typedef struct
+{
+    PointerTrackerEntry entries[POINTER_TRACKER_COUNT];
+    guint current;
+} PointerTracker;
+
+void pointer_tracker_init(PointerTracker *tracker);
+void pointer_tracker_feed(PointerTracker *tracker, double dx, double dy, uint64_t time_usec);
+double pointer_tracker_get_velocity(const PointerTracker *tracker, uint64_t time_usec);
@@ -0,0 +1,91 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "sample-ring.h"
+#include <stdatomic.h>
+
+#define CACHE_LINE_SIZE 64
+
+struct _SampleRing
+{
+    // head is written by the producer and tail by the consumer, keep them
+    // on separate cache lines so the two threads don't bounce one line.
+    atomic_size_t head;
+    char head_padding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t tail;
+    char tail_padding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_uint dropped;
+    size_t mask;
+    SpeedSample *samples;
+};
+
+SampleRing *sample_ring_new(guint capacity)
+{
+    g_assert(capacity > 0);
+    SampleRing *ring = g_new0(SampleRing, 1);
+    // Power of two capacity so indices wrap with a mask
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    ring->mask = size - 1;
+    ring->samples = g_new0(SpeedSample, size);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    return ring;
+}
+
+void sample_ring_free(SampleRing *ring)
+{
+    if (ring)
+    {
+        g_free(ring->samples);
+        g_free(ring);
+    }
+}
+
+gboolean sample_ring_push(SampleRing *ring, const SpeedSample *sample)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask)
+    {
+        // Full, the consumer is lagging behind. Drop the newest sample.
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return FALSE;
+    }
+    ring->samples[head & ring->mask] = *sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return TRUE;
+}
+
+gboolean sample_ring_pop(SampleRing *ring, SpeedSample *sample)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head)
+        return FALSE;
+    *sample = ring->samples[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return TRUE;
+}
+
+guint sample_ring_get_dropped(SampleRing *ring)
+{
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
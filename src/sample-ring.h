@@ -0,0 +1,44 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t time_usec;
+    // When libinput handed the event over and when the main loop got the
+    // sample, 0 for events that weren't captured live
+    uint64_t dequeue_time_usec;
+    uint64_t delivery_time_usec;
+    double dx, dy;
+    double speed;
+} SpeedSample;
+
+// Lock-free single-producer/single-consumer ring of speed samples.
+// sample_ring_push must only be called from one thread and
+// sample_ring_pop from one (possibly different) thread.
+typedef struct _SampleRing SampleRing;
+
+SampleRing *sample_ring_new(guint capacity);
+void sample_ring_free(SampleRing *ring);
+gboolean sample_ring_push(SampleRing *ring, const SpeedSample *sample);
+gboolean sample_ring_pop(SampleRing *ring, SpeedSample *sample);
+guint sample_ring_get_dropped(SampleRing *ring);
@@ -0,0 +1,84 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "speed-histogram.h"
+#include <math.h>
+#include <string.h>
+
+// Bins 1 to SPEED_HISTOGRAM_BIN_COUNT - 2 split the log of
+// SPEED_HISTOGRAM_MIN_SPEED..SPEED_HISTOGRAM_MAX_SPEED evenly
+#define LOG_BIN_COUNT (SPEED_HISTOGRAM_BIN_COUNT - 2)
+
+// Computed once, adding a sample only takes a log and a comparison
+static double bin_edges[SPEED_HISTOGRAM_BIN_COUNT + 1];
+
+static const double *get_bin_edges(void)
+{
+    static gsize initialized = 0;
+    if (g_once_init_enter(&initialized))
+    {
+        bin_edges[0] = 0;
+        for (int i = 1; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+            bin_edges[i] = SPEED_HISTOGRAM_MIN_SPEED *
+                           pow(SPEED_HISTOGRAM_MAX_SPEED / SPEED_HISTOGRAM_MIN_SPEED, (double)(i - 1) / LOG_BIN_COUNT);
+        bin_edges[SPEED_HISTOGRAM_BIN_COUNT] = INFINITY;
+        g_once_init_leave(&initialized, 1);
+    }
+    return bin_edges;
+}
+
+void speed_histogram_init(SpeedHistogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+    get_bin_edges();
+}
+
+int speed_histogram_get_bin(double speed)
+{
+    if (!(speed >= SPEED_HISTOGRAM_MIN_SPEED))
+        return 0;
+    double position = log(speed / SPEED_HISTOGRAM_MIN_SPEED) / log(SPEED_HISTOGRAM_MAX_SPEED / SPEED_HISTOGRAM_MIN_SPEED);
+    int bin = 1 + (int)(position * LOG_BIN_COUNT);
+    bin = MIN(bin, SPEED_HISTOGRAM_BIN_COUNT - 1);
+    // log() rounding may put a speed right at an edge on the wrong side
+    const double *edges = get_bin_edges();
+    if (speed < edges[bin])
+        bin--;
+    else if (speed >= edges[bin + 1])
+        bin++;
+    return bin;
+}
+
+double speed_histogram_get_bin_start(int bin)
+{
+    return get_bin_edges()[bin];
+}
+
+double speed_histogram_get_bin_end(int bin)
+{
+    return get_bin_edges()[bin + 1];
+}
+
+void speed_histogram_add(SpeedHistogram *histogram, double speed)
+{
+    if (!(speed >= 0) || isinf(speed))
+        return;
+    histogram->bins[speed_histogram_get_bin(speed)]++;
+    histogram->total++;
+    histogram->serial++;
+}
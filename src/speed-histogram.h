@@ -0,0 +1,44 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#define SPEED_HISTOGRAM_BIN_COUNT 1024
+#define SPEED_HISTOGRAM_MIN_SPEED 1e-3
+#define SPEED_HISTOGRAM_MAX_SPEED 1e3
+
+// Histogram of speeds over fixed log-spaced bins: the first bin holds the
+// speeds below SPEED_HISTOGRAM_MIN_SPEED, the last those from
+// SPEED_HISTOGRAM_MAX_SPEED on, and the bins between are each about 1.4%
+// wide. The counts are exact whatever range the plot shows, and adding a
+// sample is O(1) and never allocates.
+typedef struct
+{
+    guint64 bins[SPEED_HISTOGRAM_BIN_COUNT];
+    guint64 total;
+    guint serial; // bumped on every change
+} SpeedHistogram;
+
+void speed_histogram_init(SpeedHistogram *histogram);
+void speed_histogram_add(SpeedHistogram *histogram, double speed);
+int speed_histogram_get_bin(double speed);
+// Speeds of bin i are in [start, end), the end of the last bin is infinite
+double speed_histogram_get_bin_start(int bin);
+double speed_histogram_get_bin_end(int bin);
@@ -0,0 +1,268 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "plot-widget.h"
+#include <math.h>
+#include <string.h>
+
+// The fixed end points plus up to 64 handles
+#define SPLINE_MAX_POINTS 66
+// Handles keep this far apart in x so no segment gets degenerate
+#define SPLINE_MIN_GAP 1e-3
+// Releasing a dragged handle this far outside the plot removes it
+#define SPLINE_REMOVE_DISTANCE 0.1
+
+// y = y0 + c1 t + c2 t^2 + c3 t^3 with t = x - x0 on [x0, x1)
+typedef struct
+{
+    double y0, c1, c2, c3;
+} SplineSegment;
+
+// Monotone piecewise cubic Hermite spline (Fritsch & Carlson, 1980) through
+// (0, 0), the handles and (1, 1). The slopes are limited so the curve never
+// overshoots between two handles, an increasing set of handles gives an
+// increasing curve.
+typedef struct
+{
+    Curve base;
+    // points[0] and points[n_points - 1] are the fixed end points, the
+    // handles in between are sorted by x
+    Point points[SPLINE_MAX_POINTS];
+    int n_points;
+    int drag_point; // -1 when not dragging
+    // Segment k covers [breakpoints[k], breakpoints[k + 1]), kept apart from
+    // the segments so the search only touches the x values
+    double breakpoints[SPLINE_MAX_POINTS];
+    SplineSegment segments[SPLINE_MAX_POINTS - 1];
+} SplineCurve;
+
+static void spline_update_segments(SplineCurve *curve)
+{
+    int n_segments = curve->n_points - 1;
+    double secants[SPLINE_MAX_POINTS - 1];
+    double slopes[SPLINE_MAX_POINTS];
+    for (int k = 0; k < n_segments; k++)
+    {
+        const Point *p0 = &curve->points[k], *p1 = &curve->points[k + 1];
+        secants[k] = (p1->y - p0->y) / (p1->x - p0->x);
+    }
+
+    // Average of the neighbouring secants, flat at local extrema
+    slopes[0] = secants[0];
+    slopes[n_segments] = secants[n_segments - 1];
+    for (int k = 1; k < n_segments; k++)
+        slopes[k] = secants[k - 1] * secants[k] <= 0 ? 0 : (secants[k - 1] + secants[k]) / 2;
+
+    // Fritsch-Carlson: scale the slopes of a segment back into the region
+    // where its cubic is monotone
+    for (int k = 0; k < n_segments; k++)
+    {
+        if (secants[k] == 0)
+        {
+            slopes[k] = slopes[k + 1] = 0;
+            continue;
+        }
+        double alpha = slopes[k] / secants[k], beta = slopes[k + 1] / secants[k];
+        double length = hypot(alpha, beta);
+        if (length > 3)
+        {
+            slopes[k] = 3 / length * alpha * secants[k];
+            slopes[k + 1] = 3 / length * beta * secants[k];
+        }
+    }
+
+    for (int k = 0; k < n_segments; k++)
+    {
+        double h = curve->points[k + 1].x - curve->points[k].x;
+        curve->breakpoints[k] = curve->points[k].x;
+        curve->segments[k] = (SplineSegment){
+            .y0 = curve->points[k].y,
+            .c1 = slopes[k],
+            .c2 = (3 * secants[k] - 2 * slopes[k] - slopes[k + 1]) / h,
+            .c3 = (slopes[k] + slopes[k + 1] - 2 * secants[k]) / (h * h),
+        };
+    }
+    curve->breakpoints[n_segments] = curve->points[n_segments].x;
+}
+
+// Last segment starting at or before x, x in [0, 1]
+static int spline_find_segment(const SplineCurve *curve, double x)
+{
+    int lo = 0, hi = curve->n_points - 2;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (curve->breakpoints[mid] <= x)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static double spline_evaluate(const SplineCurve *curve, double x_value)
+{
+    double x = CLAMP(x_value, 0.0, 1.0);
+    int k = spline_find_segment(curve, x);
+    const SplineSegment *segment = &curve->segments[k];
+    double t = x - curve->breakpoints[k];
+    return segment->y0 + t * (segment->c1 + t * (segment->c2 + t * segment->c3));
+}
+
+static double spline_get_y_value(PlotWidget *self, double x_value)
+{
+    return spline_evaluate((SplineCurve *)plot_widget_get_curve(self), x_value);
+}
+
+static void spline_get_y_values(PlotWidget *self, const double *x_values, double *y_values, size_t n)
+{
+    const SplineCurve *curve = (SplineCurve *)plot_widget_get_curve(self);
+    for (size_t i = 0; i < n; i++)
+        y_values[i] = spline_evaluate(curve, x_values[i]);
+}
+
+static void spline_snapshot(PlotWidget *self, GtkSnapshot *snapshot)
+{
+    static const GdkRGBA curve_color = {0, 0, 0, 1};
+    static const GdkRGBA control_point_color = {1, 0, 0, 1};
+    SplineCurve *curve = (SplineCurve *)plot_widget_get_curve(self);
+
+    // Every Hermite segment is exactly a cubic Bezier with its inner control
+    // points a third of the way along the end tangents
+    GskPathBuilder *builder = gsk_path_builder_new();
+    gsk_path_builder_move_to(builder, UNPACK(plot_widget_to_screen(self, curve->points[0])));
+    for (int k = 0; k < curve->n_points - 1; k++)
+    {
+        const SplineSegment *segment = &curve->segments[k];
+        Point p0 = curve->points[k], p3 = curve->points[k + 1];
+        double h = p3.x - p0.x;
+        double end_slope = segment->c1 + h * (2 * segment->c2 + 3 * h * segment->c3);
+        Point p1 = {p0.x + h / 3, p0.y + segment->c1 * h / 3};
+        Point p2 = {p3.x - h / 3, p3.y - end_slope * h / 3};
+        gsk_path_builder_cubic_to(builder,
+                                  UNPACK(plot_widget_to_screen(self, p1)),
+                                  UNPACK(plot_widget_to_screen(self, p2)),
+                                  UNPACK(plot_widget_to_screen(self, p3)));
+    }
+    GskPath *path = gsk_path_builder_free_to_path(builder);
+    GskStroke *stroke = gsk_stroke_new(4);
+    gtk_snapshot_append_stroke(snapshot, path, stroke, &curve_color);
+    gsk_stroke_free(stroke);
+    gsk_path_unref(path);
+
+    // Draw control points
+    for (int i = 1; i < curve->n_points - 1; i++)
+        plot_widget_append_circle(snapshot, plot_widget_to_screen(self, curve->points[i]), CONTROL_POINT_RADIUS, &control_point_color);
+}
+
+// Closest handle within reach of the screen point, -1 if none. Screen x grows
+// with the handle x, so only the handles in a narrow band are looked at.
+static int spline_hit_test(PlotWidget *self, SplineCurve *curve, double x, double y)
+{
+    double reach = CONTROL_POINT_RADIUS * 2;
+    double min_x = plot_widget_from_screen(self, (Point){x - reach, y}).x;
+    int closest = -1;
+    double closest_distance = reach;
+    for (int i = MAX(spline_find_segment(curve, CLAMP(min_x, 0.0, 1.0)), 1); i < curve->n_points - 1; i++)
+    {
+        Point handle = plot_widget_to_screen(self, curve->points[i]);
+        if (handle.x > x + reach)
+            break;
+        double distance = hypot(x - handle.x, y - handle.y);
+        if (distance < closest_distance)
+        {
+            closest = i;
+            closest_distance = distance;
+        }
+    }
+    return closest;
+}
+
+static void spline_on_button_press(PlotWidget *self, double x, double y)
+{
+    SplineCurve *curve = (SplineCurve *)plot_widget_get_curve(self);
+    curve->drag_point = spline_hit_test(self, curve, x, y);
+    if (curve->drag_point >= 0)
+        return;
+
+    // Clicking elsewhere on the plot adds a handle there and starts dragging it
+    Point p = plot_widget_from_screen(self, (Point){x, y});
+    if (curve->n_points == SPLINE_MAX_POINTS || p.x <= 0 || p.x >= 1 || p.y < 0 || p.y > 1)
+        return;
+    int k = spline_find_segment(curve, p.x);
+    if (p.x - curve->points[k].x < SPLINE_MIN_GAP || curve->points[k + 1].x - p.x < SPLINE_MIN_GAP)
+        return;
+    memmove(&curve->points[k + 2], &curve->points[k + 1], (curve->n_points - k - 1) * sizeof(Point));
+    curve->points[k + 1] = p;
+    curve->n_points++;
+    curve->drag_point = k + 1;
+    spline_update_segments(curve);
+    plot_widget_curve_changed(self);
+}
+
+static void spline_on_button_release(PlotWidget *self, double x, double y)
+{
+    SplineCurve *curve = (SplineCurve *)plot_widget_get_curve(self);
+    int i = curve->drag_point;
+    curve->drag_point = -1;
+    if (i < 0)
+        return;
+
+    // Dragged off the plot, drop the handle
+    Point p = plot_widget_from_screen(self, (Point){x, y});
+    if (fmax(fmax(-p.x, p.x - 1), fmax(-p.y, p.y - 1)) > SPLINE_REMOVE_DISTANCE)
+    {
+        memmove(&curve->points[i], &curve->points[i + 1], (curve->n_points - i - 1) * sizeof(Point));
+        curve->n_points--;
+        spline_update_segments(curve);
+        plot_widget_curve_changed(self);
+    }
+}
+
+static void spline_on_motion_notify(PlotWidget *self, double x, double y)
+{
+    SplineCurve *curve = (SplineCurve *)plot_widget_get_curve(self);
+    int i = curve->drag_point;
+    if (i < 0)
+        return;
+
+    // Handles can't pass their neighbours, the order of the points is fixed
+    Point p = plot_widget_from_screen(self, (Point){x, y});
+    p.x = CLAMP(p.x, curve->points[i - 1].x + SPLINE_MIN_GAP, curve->points[i + 1].x - SPLINE_MIN_GAP);
+    p.y = CLAMP(p.y, 0.0, 1.0);
+    curve->points[i] = p;
+    spline_update_segments(curve);
+    plot_widget_curve_changed(self);
+}
+
+Curve *spline_curve_new(void)
+{
+    SplineCurve *spline_curve = g_new0(SplineCurve, 1);
+    spline_curve->base.snapshot = spline_snapshot;
+    spline_curve->base.get_y_value = spline_get_y_value;
+    spline_curve->base.get_y_values = spline_get_y_values;
+    spline_curve->base.on_button_press = spline_on_button_press;
+    spline_curve->base.on_button_release = spline_on_button_release;
+    spline_curve->base.on_motion_notify = spline_on_motion_notify;
+    static const Point initial_points[] = {{0, 0}, {0.25, 0.08}, {0.5, 0.3}, {0.75, 0.62}, {1, 1}};
+    memcpy(spline_curve->points, initial_points, sizeof(initial_points));
+    spline_curve->n_points = G_N_ELEMENTS(initial_points);
+    spline_curve->drag_point = -1;
+    spline_update_segments(spline_curve);
+    return (Curve *)spline_curve;
+}
@@ -16,24 +16,43 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "accel-property-mirror.h"
 #include "device-manager.h"
 #include <glib.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/extensions/XInput2.h>
 #include <stdio.h>
+#include <string.h>
+
+// Interned once, and again when the device hierarchy changes
+typedef struct
+{
+    Atom float_type;
+    Atom device_node;
+    // Indexed by ACCEL_PROPERTY_*
+    guint32 accel_properties[ACCEL_PROPERTY_COUNT];
+} X11Atoms;
 
 typedef struct _X11AccelSettingsManager
 {
     AccelSettingsManager base;
     Display *display;
+    int xi_opcode;
+    X11Atoms atoms;
+    // Device node -> XI device id. Rebuilt on the first lookup after an
+    // XI_HierarchyChanged event.
+    GHashTable *device_ids;
+    gboolean device_ids_valid;
+    // XI device id -> AccelPropertyMirror
+    GHashTable *mirrors;
 } X11AccelSettingsManager;
 
 static gboolean set_property(Display *display, int device_id, Atom property, Atom type, int format,
                              unsigned char *data, int nelements)
 {
+    // Queued, the caller syncs once for the whole transaction
     XIChangeProperty(display, device_id, property, type, format, XIPropModeReplace, data, nelements);
-    XSync(display, False);
     return TRUE;
 }
 
@@ -58,21 +77,19 @@ static gboolean set_atom_property_int8_array(Display *display, int device_id, At
     return set_property(display, device_id, atom, XA_INTEGER, 8, (unsigned char *)values, nvalues);
 }
 
-static gboolean set_atom_property_double(Display *display, int device_id, Atom atom, double value)
+static gboolean set_atom_property_double(Display *display, int device_id, Atom atom, Atom float_atom, double value)
 {
     float float_value = (float)value;
-    Atom float_atom = XInternAtom(display, "FLOAT", False);
     return set_property(display, device_id, atom, float_atom, 32, (unsigned char *)&float_value, 1);
 }
 
-static gboolean set_atom_property_double_array(Display *display, int device_id, Atom atom, double *values, int nvalues)
+static gboolean set_atom_property_double_array(Display *display, int device_id, Atom atom, Atom float_atom, double *values, int nvalues)
 {
     float *float_values = g_new(float, nvalues);
     for (int i = 0; i < nvalues; i++)
     {
         float_values[i] = (float)values[i];
     }
-    Atom float_atom = XInternAtom(display, "FLOAT", False);
     gboolean success = set_property(display, device_id, atom, float_atom, 32, (unsigned char *)float_values, nvalues);
     g_free(float_values);
     return success;
@@ -94,11 +111,10 @@ static gboolean get_atom_property_int8_array(Display *display, int device_id, At
     return success;
 }
 
-static gboolean get_atom_property_double_array(Display *display, int device_id, Atom atom, double *array, int array_len, int *nitems)
+static gboolean get_atom_property_double_array(Display *display, int device_id, Atom atom, Atom float_atom, double *array, int array_len, int *nitems)
 {
     unsigned char *prop = NULL;
     unsigned long nitems_local;
-    Atom float_atom = XInternAtom(display, "FLOAT", False);
     gboolean success = get_property(display, device_id, atom, float_atom, 32, &prop, &nitems_local);
     if (!success || !prop)
         return FALSE;
@@ -113,11 +129,10 @@ static gboolean get_atom_property_double_array(Display *display, int device_id,
     return success;
 }
 
-static gboolean get_atom_property_double(Display *display, int device_id, Atom atom, double *value)
+static gboolean get_atom_property_double(Display *display, int device_id, Atom atom, Atom float_atom, double *value)
 {
     unsigned char *prop = NULL;
     unsigned long nitems;
-    Atom float_atom = XInternAtom(display, "FLOAT", False);
     gboolean success = get_property(display, device_id, atom, float_atom, 32, &prop, &nitems);
     if (!success || !prop)
         return FALSE;
@@ -128,111 +143,224 @@ static gboolean get_atom_property_double(Display *display, int device_id, Atom a
     return success;
 }
 
-static void x11_get_accel_function_atoms(Display *display, Atom *accel_points_atom, Atom *accel_step_atom,
-                                         MovementType movement_type)
+static void x11_intern_atoms(X11AccelSettingsManager *x11_manager)
 {
-    char accel_points_atom_name[64];
-    char accel_step_atom_name[64];
-
-    snprintf(accel_points_atom_name, sizeof(accel_points_atom_name), "libinput Accel Custom %s Points", MOVEMENT_TYPE_STRINGS[movement_type]);
-    snprintf(accel_step_atom_name, sizeof(accel_step_atom_name), "libinput Accel Custom %s Step", MOVEMENT_TYPE_STRINGS[movement_type]);
+    // Writable copies, XInternAtoms takes char **
+    char names[2 + ACCEL_PROPERTY_COUNT][64] = {"FLOAT", "Device Node"};
+    char *atom_names[G_N_ELEMENTS(names)];
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+        accel_property_get_name(i, names[2 + i], sizeof(names[0]));
+    for (gsize i = 0; i < G_N_ELEMENTS(names); i++)
+        atom_names[i] = names[i];
+
+    // FLOAT is created if missing, the libinput properties only exist once
+    // the driver registered them, leave them None until then.
+    Atom atoms[G_N_ELEMENTS(atom_names)];
+    XInternAtoms(x11_manager->display, atom_names, 1, False, atoms);
+    XInternAtoms(x11_manager->display, atom_names + 1, G_N_ELEMENTS(atom_names) - 1, True, atoms + 1);
+
+    X11Atoms *x11_atoms = &x11_manager->atoms;
+    x11_atoms->float_type = atoms[0];
+    x11_atoms->device_node = atoms[1];
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+        x11_atoms->accel_properties[i] = atoms[2 + i];
+}
 
-    *accel_points_atom = XInternAtom(display, accel_points_atom_name, True);
-    *accel_step_atom = XInternAtom(display, accel_step_atom_name, True);
+static void x11_process_events(X11AccelSettingsManager *x11_manager)
+{
+    // Nothing reads this connection's events otherwise, drain them here
+    Display *display = x11_manager->display;
+    while (XPending(display))
+    {
+        XEvent event;
+        XNextEvent(display, &event);
+        XGenericEventCookie *cookie = &event.xcookie;
+        if (cookie->type != GenericEvent || cookie->extension != x11_manager->xi_opcode)
+            continue;
+        if (cookie->evtype == XI_HierarchyChanged)
+        {
+            // Device ids may be reused, drop everything keyed by them
+            x11_manager->device_ids_valid = FALSE;
+            g_hash_table_remove_all(x11_manager->mirrors);
+        }
+        else if (cookie->evtype == XI_PropertyEvent && XGetEventData(display, cookie))
+        {
+            XIPropertyEvent *property_event = cookie->data;
+            AccelPropertyMirror *mirror = g_hash_table_lookup(x11_manager->mirrors, GINT_TO_POINTER(property_event->deviceid));
+            int property_index = accel_property_get_index(x11_manager->atoms.accel_properties, property_event->property);
+            if (mirror && property_index >= 0)
+                accel_property_mirror_property_changed(mirror, property_index);
+            XFreeEventData(display, cookie);
+        }
+    }
 }
 
-int x11_get_device_id(Display *display, Device *device)
+static void x11_update_device_ids(X11AccelSettingsManager *x11_manager)
 {
-    char *device_node = device->node;
+    Display *display = x11_manager->display;
+    g_hash_table_remove_all(x11_manager->device_ids);
+    // A new device may be the first to register the libinput properties
+    x11_intern_atoms(x11_manager);
+
     int ndevices;
     XIDeviceInfo *devices = XIQueryDevice(display, XIAllDevices, &ndevices);
-    int device_id = -1;
-    char *property_value;
-    size_t nitems;
-    Atom property_atom = XInternAtom(display, "Device Node", True);
-
     for (int i = 0; i < ndevices; i++)
     {
-        if (get_property(display, devices[i].deviceid, property_atom, XA_STRING, 8, (unsigned char **)&property_value, &nitems))
+        char *property_value = NULL;
+        unsigned long nitems;
+        if (x11_manager->atoms.device_node != None &&
+            get_property(display, devices[i].deviceid, x11_manager->atoms.device_node, XA_STRING, 8, (unsigned char **)&property_value, &nitems))
         {
-            if (g_strcmp0(property_value, device_node) == 0)
-            {
-                device_id = devices[i].deviceid;
-                XFree(property_value);
-                break;
-            }
+            g_hash_table_insert(x11_manager->device_ids, g_strdup(property_value), GINT_TO_POINTER(devices[i].deviceid));
             XFree(property_value);
         }
     }
-
     XIFreeDeviceInfo(devices);
-    return device_id;
+    x11_manager->device_ids_valid = TRUE;
 }
 
-static gboolean x11_set_accel_function(Display *display, int device_id, CustomAccelFunction *custom_accel_function, MovementType movement_type)
+int x11_get_device_id(X11AccelSettingsManager *x11_manager, Device *device)
 {
-    Atom accel_points_atom;
-    Atom accel_step_atom;
-    x11_get_accel_function_atoms(display, &accel_points_atom, &accel_step_atom, movement_type);
-    gboolean success = set_atom_property_double_array(display, device_id, accel_points_atom, custom_accel_function->points, custom_accel_function->npoints);
-    success = success && set_atom_property_double(display, device_id, accel_step_atom, custom_accel_function->step);
-    return success;
+    x11_process_events(x11_manager);
+    if (!x11_manager->device_ids_valid)
+        x11_update_device_ids(x11_manager);
+
+    gpointer device_id;
+    if (!g_hash_table_lookup_extended(x11_manager->device_ids, device->node, NULL, &device_id))
+        return -1;
+    return GPOINTER_TO_INT(device_id);
 }
 
-static gboolean x11_set_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
+static gboolean x11_fetch_property(Display *display, const X11Atoms *atoms, int device_id, AccelSettings *settings, int property_index)
 {
-    X11AccelSettingsManager *x11_manager = (X11AccelSettingsManager *)self;
-    Display *display = x11_manager->display;
-    int device_id = x11_get_device_id(display, device);
-    if (device_id == -1)
+    Atom property = atoms->accel_properties[property_index];
+    if (property_index == ACCEL_PROPERTY_PROFILE)
+    {
+        int profile_size;
+        return get_atom_property_int8_array(display, device_id, property, settings->profile, 3, &profile_size);
+    }
+    int movement_type = ACCEL_PROPERTY_MOVEMENT_TYPE(property_index);
+    CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[movement_type];
+    if (property_index == ACCEL_PROPERTY_POINTS(movement_type))
+        return get_atom_property_double_array(display, device_id, property, atoms->float_type, custom_accel_function->points, 64, &custom_accel_function->npoints);
+    return get_atom_property_double(display, device_id, property, atoms->float_type, &custom_accel_function->step);
+}
+
+// Returns the device's mirror with every property fetched, or NULL
+static AccelPropertyMirror *x11_get_mirror(X11AccelSettingsManager *x11_manager, Device *device, int *device_id)
+{
+    *device_id = x11_get_device_id(x11_manager, device);
+    if (*device_id == -1)
     {
         g_warning("Failed to get device id for device: %s", device->name);
-        return FALSE;
+        return NULL;
     }
-    Atom accel_profile_atom = XInternAtom(display, "libinput Accel Profile Enabled", True);
-    gboolean success = set_atom_property_int8_array(display, device_id, accel_profile_atom, settings->profile, 3);
 
-    for (int i = 0; i < MOVEMENT_TYPE_COUNT && success; i++)
+    AccelPropertyMirror *mirror = g_hash_table_lookup(x11_manager->mirrors, GINT_TO_POINTER(*device_id));
+    if (!mirror)
     {
-        CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[i];
-        success = x11_set_accel_function(display, device_id, custom_accel_function, (MovementType)i);
+        mirror = accel_property_mirror_new();
+        g_hash_table_insert(x11_manager->mirrors, GINT_TO_POINTER(*device_id), mirror);
     }
 
-    return success;
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+    {
+        if (!(mirror->stale & (1u << i)))
+            continue;
+        if (!x11_fetch_property(x11_manager->display, &x11_manager->atoms, *device_id, &mirror->settings, i))
+            return NULL;
+        mirror->stale &= ~(1u << i);
+    }
+    return mirror;
 }
 
-static gboolean x11_get_accel_function(Display *display, int device_id, CustomAccelFunction *custom_accel_function, MovementType movement_type)
+// The error handler is process wide, errors of other displays (GDK's) go on
+// to the handler that was installed before
+static Display *trapped_display;
+static unsigned char trapped_error_code;
+static XErrorHandler untrapped_error_handler;
+
+static int x11_trap_error(Display *display, XErrorEvent *event)
 {
-    Atom accel_points_atom;
-    Atom accel_step_atom;
-    x11_get_accel_function_atoms(display, &accel_points_atom, &accel_step_atom, movement_type);
+    if (display != trapped_display)
+        return untrapped_error_handler ? untrapped_error_handler(display, event) : 0;
+    if (trapped_error_code == Success)
+        trapped_error_code = event->error_code;
+    return 0;
+}
 
-    gboolean success = get_atom_property_double_array(display, device_id, accel_points_atom, custom_accel_function->points, 64, &custom_accel_function->npoints);
-    success = success && get_atom_property_double(display, device_id, accel_step_atom, &custom_accel_function->step);
-    return success;
+static void x11_error_trap_push(Display *display)
+{
+    // Errors of earlier requests aren't ours to catch
+    XSync(display, False);
+    trapped_display = display;
+    trapped_error_code = Success;
+    untrapped_error_handler = XSetErrorHandler(x11_trap_error);
 }
 
-static gboolean x11_get_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
+// Syncs and returns the first error since the push, or Success
+static unsigned char x11_error_trap_pop(Display *display)
+{
+    XSync(display, False);
+    XSetErrorHandler(untrapped_error_handler);
+    trapped_display = NULL;
+    return trapped_error_code;
+}
+
+static gboolean x11_set_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
 {
     X11AccelSettingsManager *x11_manager = (X11AccelSettingsManager *)self;
     Display *display = x11_manager->display;
-    int device_id = x11_get_device_id(display, device);
-    if (device_id == -1)
-    {
-        g_warning("Failed to get device id for device: %s", device->name);
+    const X11Atoms *atoms = &x11_manager->atoms;
+    int device_id;
+    AccelPropertyMirror *mirror = x11_get_mirror(x11_manager, device, &device_id);
+    if (!mirror)
         return FALSE;
-    }
-    Atom accel_profile_atom = XInternAtom(display, "libinput Accel Profile Enabled", True);
-    int profile_size;
-    gboolean success = get_atom_property_int8_array(display, device_id, accel_profile_atom, settings->profile, 3, &profile_size);
 
-    for (int i = 0; i < MOVEMENT_TYPE_COUNT && success; i++)
+    // Only send what differs from the server's values
+    guint32 changes = accel_property_mirror_get_changes(mirror, settings);
+    if (changes == 0)
+        return TRUE;
+    x11_error_trap_push(display);
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
     {
-        CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[i];
-        success = x11_get_accel_function(display, device_id, custom_accel_function, (MovementType)i);
+        if (!(changes & (1u << i)))
+            continue;
+        Atom property = atoms->accel_properties[i];
+        int movement_type = ACCEL_PROPERTY_MOVEMENT_TYPE(i);
+        CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[movement_type];
+        if (i == ACCEL_PROPERTY_PROFILE)
+            set_atom_property_int8_array(display, device_id, property, settings->profile, 3);
+        else if (i == ACCEL_PROPERTY_POINTS(movement_type))
+            set_atom_property_double_array(display, device_id, property, atoms->float_type, custom_accel_function->points, custom_accel_function->npoints);
+        else
+            set_atom_property_double(display, device_id, property, atoms->float_type, custom_accel_function->step);
+        mirror->pending_writes[i]++;
     }
 
-    return success;
+    // One round trip for the whole transaction, then account for the
+    // property events it generated
+    unsigned char error_code = x11_error_trap_pop(display);
+    if (error_code != Success)
+        g_warning("Failed to set accel properties of %s: X error %d", device->name, error_code);
+    x11_process_events(x11_manager);
+
+    // The hierarchy may have changed meanwhile and taken the mirror with it
+    mirror = g_hash_table_lookup(x11_manager->mirrors, GINT_TO_POINTER(device_id));
+    if (mirror)
+        accel_property_mirror_written(mirror, settings, changes, error_code == Success);
+    return error_code == Success;
+}
+
+static gboolean x11_get_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
+{
+    X11AccelSettingsManager *x11_manager = (X11AccelSettingsManager *)self;
+    int device_id;
+    AccelPropertyMirror *mirror = x11_get_mirror(x11_manager, device, &device_id);
+    if (!mirror)
+        return FALSE;
+    *settings = mirror->settings;
+    return TRUE;
 }
 
 void x11_accel_settings_manager_free(AccelSettingsManager *self)
@@ -244,6 +372,10 @@ void x11_accel_settings_manager_free(AccelSettingsManager *self)
     {
         XCloseDisplay(x11_manager->display);
     }
+    if (x11_manager->device_ids)
+        g_hash_table_destroy(x11_manager->device_ids);
+    if (x11_manager->mirrors)
+        g_hash_table_destroy(x11_manager->mirrors);
     g_free(x11_manager);
 }
 
@@ -261,5 +393,26 @@ AccelSettingsManager *x11_accel_settings_manager_new(void)
         return NULL;
     }
 
+    int event, error;
+    if (!XQueryExtension(manager->display, "XInputExtension", &manager->xi_opcode, &event, &error))
+    {
+        g_warning("X Input extension not available");
+        XCloseDisplay(manager->display);
+        g_free(manager);
+        return NULL;
+    }
+
+    // Device ids only change when devices are added or removed, property
+    // events keep the mirrors current
+    unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+    XIEventMask mask = {.deviceid = XIAllDevices, .mask_len = sizeof(mask_bits), .mask = mask_bits};
+    XISetMask(mask_bits, XI_HierarchyChanged);
+    XISetMask(mask_bits, XI_PropertyEvent);
+    XISelectEvents(manager->display, DefaultRootWindow(manager->display), &mask, 1);
+
+    manager->device_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    manager->mirrors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    x11_update_device_ids(manager);
+
     return (AccelSettingsManager *)manager;
 }
@@ -0,0 +1,408 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "accel-property-mirror.h"
+#include "device-manager.h"
+#include <glib.h>
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+#include <stdio.h>
+#include <string.h>
+
+// Same interface as the Xlib backend, but every batch of requests is sent
+// at once and the replies are collected afterwards, so a whole get or set
+// costs at most one round trip, and none when the mirror is current.
+
+#define XCB_ATOM_COUNT (2 + ACCEL_PROPERTY_COUNT)
+
+typedef struct
+{
+    xcb_atom_t float_type;
+    xcb_atom_t device_node;
+    // Indexed by ACCEL_PROPERTY_*
+    xcb_atom_t accel_properties[ACCEL_PROPERTY_COUNT];
+} XcbAtoms;
+
+typedef struct _XcbAccelSettingsManager
+{
+    AccelSettingsManager base;
+    xcb_connection_t *connection;
+    xcb_window_t root;
+    uint8_t xi_opcode;
+    XcbAtoms atoms;
+    // Device node -> XI device id. Rebuilt on the first lookup after an
+    // XI_HierarchyChanged event.
+    GHashTable *device_ids;
+    gboolean device_ids_valid;
+    // XI device id -> AccelPropertyMirror
+    GHashTable *mirrors;
+} XcbAccelSettingsManager;
+
+static void xcb_manager_intern_atoms(XcbAccelSettingsManager *xcb_manager)
+{
+    char names[XCB_ATOM_COUNT][64] = {"FLOAT", "Device Node"};
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+        accel_property_get_name(i, names[2 + i], sizeof(names[0]));
+
+    // FLOAT is created if missing, the libinput properties only exist once
+    // the driver registered them, leave them XCB_ATOM_NONE until then.
+    xcb_intern_atom_cookie_t cookies[XCB_ATOM_COUNT];
+    for (int i = 0; i < XCB_ATOM_COUNT; i++)
+        cookies[i] = xcb_intern_atom(xcb_manager->connection, i != 0, strlen(names[i]), names[i]);
+
+    xcb_atom_t atoms[XCB_ATOM_COUNT];
+    for (int i = 0; i < XCB_ATOM_COUNT; i++)
+    {
+        xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(xcb_manager->connection, cookies[i], NULL);
+        atoms[i] = reply ? reply->atom : XCB_ATOM_NONE;
+        free(reply);
+    }
+
+    XcbAtoms *xcb_atoms = &xcb_manager->atoms;
+    xcb_atoms->float_type = atoms[0];
+    xcb_atoms->device_node = atoms[1];
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+        xcb_atoms->accel_properties[i] = atoms[2 + i];
+}
+
+static xcb_input_xi_get_property_cookie_t xcb_manager_get_property(XcbAccelSettingsManager *xcb_manager, xcb_input_device_id_t device_id,
+                                                                   xcb_atom_t property, xcb_atom_t type)
+{
+    return xcb_input_xi_get_property(xcb_manager->connection, device_id, 0, property, type, 0, UINT32_MAX);
+}
+
+// Returns the items of a reply of the expected type and format, or NULL
+static void *xcb_manager_get_property_items(xcb_input_xi_get_property_reply_t *reply, xcb_atom_t type, uint8_t format, uint32_t *nitems)
+{
+    if (!reply || reply->type != type || reply->format != format)
+        return NULL;
+    *nitems = reply->num_items;
+    return xcb_input_xi_get_property_items(reply);
+}
+
+static xcb_atom_t xcb_manager_get_property_type(const XcbAtoms *atoms, int property_index)
+{
+    return property_index == ACCEL_PROPERTY_PROFILE ? XCB_ATOM_INTEGER : atoms->float_type;
+}
+
+// Stores the value of one accel property reply in settings
+static gboolean xcb_manager_read_property(xcb_input_xi_get_property_reply_t *reply, const XcbAtoms *atoms,
+                                          AccelSettings *settings, int property_index)
+{
+    uint32_t nitems;
+    if (property_index == ACCEL_PROPERTY_PROFILE)
+    {
+        const uint8_t *profile = xcb_manager_get_property_items(reply, XCB_ATOM_INTEGER, 8, &nitems);
+        if (!profile || nitems > G_N_ELEMENTS(settings->profile))
+            return FALSE;
+        memcpy(settings->profile, profile, nitems);
+        return TRUE;
+    }
+
+    int movement_type = ACCEL_PROPERTY_MOVEMENT_TYPE(property_index);
+    CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[movement_type];
+    const float *values = xcb_manager_get_property_items(reply, atoms->float_type, 32, &nitems);
+    if (property_index == ACCEL_PROPERTY_POINTS(movement_type))
+    {
+        if (!values || nitems > G_N_ELEMENTS(custom_accel_function->points))
+            return FALSE;
+        custom_accel_function->npoints = nitems;
+        for (uint32_t j = 0; j < nitems; j++)
+            custom_accel_function->points[j] = values[j];
+        return TRUE;
+    }
+    if (!values || nitems != 1)
+        return FALSE;
+    custom_accel_function->step = *values;
+    return TRUE;
+}
+
+static void xcb_manager_process_events(XcbAccelSettingsManager *xcb_manager)
+{
+    // Never blocks, only drains what already arrived
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(xcb_manager->connection)))
+    {
+        xcb_ge_generic_event_t *generic_event = (xcb_ge_generic_event_t *)event;
+        if ((event->response_type & ~0x80) != XCB_GE_GENERIC || generic_event->extension != xcb_manager->xi_opcode)
+        {
+            free(event);
+            continue;
+        }
+        if (generic_event->event_type == XCB_INPUT_HIERARCHY)
+        {
+            // Device ids may be reused, drop everything keyed by them
+            xcb_manager->device_ids_valid = FALSE;
+            g_hash_table_remove_all(xcb_manager->mirrors);
+        }
+        else if (generic_event->event_type == XCB_INPUT_PROPERTY)
+        {
+            xcb_input_property_event_t *property_event = (xcb_input_property_event_t *)event;
+            AccelPropertyMirror *mirror = g_hash_table_lookup(xcb_manager->mirrors, GINT_TO_POINTER(property_event->deviceid));
+            int property_index = accel_property_get_index(xcb_manager->atoms.accel_properties, property_event->property);
+            if (mirror && property_index >= 0)
+                accel_property_mirror_property_changed(mirror, property_index);
+        }
+        free(event);
+    }
+}
+
+static void xcb_manager_update_device_ids(XcbAccelSettingsManager *xcb_manager)
+{
+    xcb_connection_t *connection = xcb_manager->connection;
+    g_hash_table_remove_all(xcb_manager->device_ids);
+    // A new device may be the first to register the libinput properties
+    xcb_manager_intern_atoms(xcb_manager);
+
+    xcb_input_xi_query_device_reply_t *devices =
+        xcb_input_xi_query_device_reply(connection, xcb_input_xi_query_device(connection, XCB_INPUT_DEVICE_ALL), NULL);
+    if (!devices)
+        return;
+
+    // One Device Node request per device, all in flight at once
+    int ndevices = xcb_input_xi_query_device_infos_length(devices);
+    xcb_input_device_id_t *device_ids = g_new(xcb_input_device_id_t, ndevices);
+    xcb_input_xi_get_property_cookie_t *cookies = g_new(xcb_input_xi_get_property_cookie_t, ndevices);
+    xcb_input_xi_device_info_iterator_t iter = xcb_input_xi_query_device_infos_iterator(devices);
+    for (int i = 0; i < ndevices; i++, xcb_input_xi_device_info_next(&iter))
+    {
+        device_ids[i] = iter.data->deviceid;
+        cookies[i] = xcb_manager_get_property(xcb_manager, device_ids[i], xcb_manager->atoms.device_node, XCB_ATOM_STRING);
+    }
+
+    for (int i = 0; i < ndevices; i++)
+    {
+        xcb_input_xi_get_property_reply_t *reply = xcb_input_xi_get_property_reply(connection, cookies[i], NULL);
+        uint32_t nitems;
+        const char *node = xcb_manager_get_property_items(reply, XCB_ATOM_STRING, 8, &nitems);
+        if (node)
+            g_hash_table_insert(xcb_manager->device_ids, g_strndup(node, nitems), GINT_TO_POINTER(device_ids[i]));
+        free(reply);
+    }
+
+    g_free(cookies);
+    g_free(device_ids);
+    free(devices);
+    xcb_manager->device_ids_valid = TRUE;
+}
+
+static int xcb_manager_get_device_id(XcbAccelSettingsManager *xcb_manager, Device *device)
+{
+    xcb_manager_process_events(xcb_manager);
+    if (!xcb_manager->device_ids_valid)
+        xcb_manager_update_device_ids(xcb_manager);
+
+    gpointer device_id;
+    if (!g_hash_table_lookup_extended(xcb_manager->device_ids, device->node, NULL, &device_id))
+    {
+        g_warning("Failed to get device id for device: %s", device->name);
+        return -1;
+    }
+    return GPOINTER_TO_INT(device_id);
+}
+
+// Returns the device's mirror with every property fetched, or NULL. Stale
+// properties are requested together, so this costs at most one round trip.
+static AccelPropertyMirror *xcb_manager_get_mirror(XcbAccelSettingsManager *xcb_manager, Device *device, int *device_id)
+{
+    xcb_connection_t *connection = xcb_manager->connection;
+    *device_id = xcb_manager_get_device_id(xcb_manager, device);
+    if (*device_id == -1)
+        return NULL;
+
+    AccelPropertyMirror *mirror = g_hash_table_lookup(xcb_manager->mirrors, GINT_TO_POINTER(*device_id));
+    if (!mirror)
+    {
+        mirror = accel_property_mirror_new();
+        g_hash_table_insert(xcb_manager->mirrors, GINT_TO_POINTER(*device_id), mirror);
+    }
+    if (!mirror->stale)
+        return mirror;
+
+    xcb_input_xi_get_property_cookie_t cookies[ACCEL_PROPERTY_COUNT] = {{0}};
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+    {
+        if (mirror->stale & (1u << i))
+            cookies[i] = xcb_manager_get_property(xcb_manager, *device_id, xcb_manager->atoms.accel_properties[i],
+                                                  xcb_manager_get_property_type(&xcb_manager->atoms, i));
+    }
+
+    // Collect every reply even after a failure, so none is left pending
+    gboolean success = TRUE;
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+    {
+        if (!(mirror->stale & (1u << i)))
+            continue;
+        xcb_input_xi_get_property_reply_t *reply = xcb_input_xi_get_property_reply(connection, cookies[i], NULL);
+        if (xcb_manager_read_property(reply, &xcb_manager->atoms, &mirror->settings, i))
+            mirror->stale &= ~(1u << i);
+        else
+            success = FALSE;
+        free(reply);
+    }
+    return success ? mirror : NULL;
+}
+
+static gboolean xcb_manager_set_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
+{
+    XcbAccelSettingsManager *xcb_manager = (XcbAccelSettingsManager *)self;
+    xcb_connection_t *connection = xcb_manager->connection;
+    const XcbAtoms *atoms = &xcb_manager->atoms;
+    int device_id;
+    AccelPropertyMirror *mirror = xcb_manager_get_mirror(xcb_manager, device, &device_id);
+    if (!mirror)
+        return FALSE;
+
+    // Only send what differs from the server's values, all in one flight
+    guint32 changes = accel_property_mirror_get_changes(mirror, settings);
+    if (changes == 0)
+        return TRUE;
+    xcb_void_cookie_t cookies[ACCEL_PROPERTY_COUNT];
+    int ncookies = 0;
+    for (int i = 0; i < ACCEL_PROPERTY_COUNT; i++)
+    {
+        if (!(changes & (1u << i)))
+            continue;
+        xcb_atom_t property = atoms->accel_properties[i];
+        int movement_type = ACCEL_PROPERTY_MOVEMENT_TYPE(i);
+        CustomAccelFunction *custom_accel_function = &settings->custom_accel_functions[movement_type];
+        if (i == ACCEL_PROPERTY_PROFILE)
+        {
+            cookies[ncookies++] = xcb_input_xi_change_property_checked(connection, device_id, XCB_PROP_MODE_REPLACE, 8,
+                                                                        property, XCB_ATOM_INTEGER,
+                                                                        G_N_ELEMENTS(settings->profile), settings->profile);
+        }
+        else if (i == ACCEL_PROPERTY_POINTS(movement_type))
+        {
+            float points[G_N_ELEMENTS(custom_accel_function->points)];
+            for (int j = 0; j < custom_accel_function->npoints; j++)
+                points[j] = (float)custom_accel_function->points[j];
+            // The request data is copied into the output buffer when queued
+            cookies[ncookies++] = xcb_input_xi_change_property_checked(connection, device_id, XCB_PROP_MODE_REPLACE, 32,
+                                                                        property, atoms->float_type,
+                                                                        custom_accel_function->npoints, points);
+        }
+        else
+        {
+            float step = (float)custom_accel_function->step;
+            cookies[ncookies++] = xcb_input_xi_change_property_checked(connection, device_id, XCB_PROP_MODE_REPLACE, 32,
+                                                                        property, atoms->float_type, 1, &step);
+        }
+        mirror->pending_writes[i]++;
+    }
+
+    // The first check waits for the round trip, the others are already answered
+    gboolean success = TRUE;
+    for (int i = 0; i < ncookies; i++)
+    {
+        xcb_generic_error_t *error = xcb_request_check(connection, cookies[i]);
+        if (error)
+        {
+            g_warning("Failed to set accel property of %s: X error %d", device->name, error->error_code);
+            free(error);
+            success = FALSE;
+        }
+    }
+    // Account for the property events the writes generated
+    xcb_manager_process_events(xcb_manager);
+
+    // The hierarchy may have changed meanwhile and taken the mirror with it
+    mirror = g_hash_table_lookup(xcb_manager->mirrors, GINT_TO_POINTER(device_id));
+    if (mirror)
+        accel_property_mirror_written(mirror, settings, changes, success);
+    return success;
+}
+
+static gboolean xcb_manager_get_accel_settings(AccelSettingsManager *self, Device *device, AccelSettings *settings)
+{
+    XcbAccelSettingsManager *xcb_manager = (XcbAccelSettingsManager *)self;
+    int device_id;
+    AccelPropertyMirror *mirror = xcb_manager_get_mirror(xcb_manager, device, &device_id);
+    if (!mirror)
+        return FALSE;
+    *settings = mirror->settings;
+    return TRUE;
+}
+
+void xcb_accel_settings_manager_free(AccelSettingsManager *self)
+{
+    if (!self)
+        return;
+    XcbAccelSettingsManager *xcb_manager = (XcbAccelSettingsManager *)self;
+    if (xcb_manager->connection)
+        xcb_disconnect(xcb_manager->connection);
+    if (xcb_manager->device_ids)
+        g_hash_table_destroy(xcb_manager->device_ids);
+    if (xcb_manager->mirrors)
+        g_hash_table_destroy(xcb_manager->mirrors);
+    g_free(xcb_manager);
+}
+
+AccelSettingsManager *xcb_accel_settings_manager_new(void)
+{
+    int screen_number;
+    xcb_connection_t *connection = xcb_connect(NULL, &screen_number);
+    if (xcb_connection_has_error(connection))
+    {
+        g_warning("Failed to connect to the X server");
+        xcb_disconnect(connection);
+        return NULL;
+    }
+
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(connection, &xcb_input_id);
+    xcb_input_xi_query_version_reply_t *version =
+        extension && extension->present ? xcb_input_xi_query_version_reply(connection, xcb_input_xi_query_version(connection, 2, 2), NULL) : NULL;
+    if (!version || version->major_version < 2)
+    {
+        g_warning("X Input extension 2 not available");
+        free(version);
+        xcb_disconnect(connection);
+        return NULL;
+    }
+    free(version);
+
+    XcbAccelSettingsManager *manager = g_new0(XcbAccelSettingsManager, 1);
+    manager->base.free = xcb_accel_settings_manager_free;
+    manager->base.set_accel_settings = xcb_manager_set_accel_settings;
+    manager->base.get_accel_settings = xcb_manager_get_accel_settings;
+    manager->connection = connection;
+    manager->xi_opcode = extension->major_opcode;
+
+    xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(connection));
+    for (int i = 0; i < screen_number && screens.rem > 0; i++)
+        xcb_screen_next(&screens);
+    manager->root = screens.data->root;
+
+    // Device ids only change when devices are added or removed, property
+    // events keep the mirrors current
+    struct
+    {
+        xcb_input_event_mask_t header;
+        uint32_t mask;
+    } event_mask = {
+        .header = {.deviceid = XCB_INPUT_DEVICE_ALL, .mask_len = 1},
+        .mask = XCB_INPUT_XI_EVENT_MASK_HIERARCHY | XCB_INPUT_XI_EVENT_MASK_PROPERTY,
+    };
+    xcb_input_xi_select_events(connection, manager->root, 1, &event_mask.header);
+
+    manager->device_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    manager->mirrors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    xcb_manager_update_device_ids(manager);
+
+    return (AccelSettingsManager *)manager;
+}
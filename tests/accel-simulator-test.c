@@ -0,0 +1,83 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Feeds the simulator a known event sequence and checks the speeds it
+// measures against libinput's custom filter: distance over the time since the
+// previous event, 7 ms for the first event and after a pause over 1 s.
+
+#include "accel-simulator.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define T0 5000000
+
+typedef struct
+{
+    SimulatorEvent event;
+    double speed;
+} Step;
+
+int main(void)
+{
+    // Doubles the speed up to 1 units/ms, then grows by 3 per units/ms
+    CustomAccelFunction custom_accel_function = {.step = 1, .npoints = 3, .points = {0, 2, 5}};
+    AccelSimulator simulator;
+    accel_simulator_init(&simulator, &custom_accel_function);
+
+    static const Step steps[] = {
+        // First event
+        {{T0, 3, 4}, 5.0 / 7},
+        {{T0 + 8000, 6, 8}, 10.0 / 8},
+        {{T0 + 9000, 0, 0.5}, 0.5},
+        // A pause of exactly 1 s still counts
+        {{T0 + 1009000, 1000, 0}, 1.0},
+        // Past it the interval is 7 ms again
+        {{T0 + 2009001, 0, 1.4}, 0.2},
+        // No time passed, the previous speed is kept
+        {{T0 + 2009001, 5, 0}, 0.2},
+    };
+
+    int failures = 0;
+    for (gsize i = 0; i < G_N_ELEMENTS(steps); i++)
+    {
+        SimulatorEvent accelerated;
+        accel_simulator_filter(&simulator, &steps[i].event, &accelerated);
+        double speed = steps[i].speed;
+        double factor = custom_accel_function_get_speed(&simulator.custom_accel_function, speed) / speed;
+        if (fabs(simulator.speed - speed) > 1e-12 || fabs(accelerated.dx - steps[i].event.dx * factor) > 1e-9 ||
+            fabs(accelerated.dy - steps[i].event.dy * factor) > 1e-9)
+        {
+            fprintf(stderr, "event %" G_GSIZE_FORMAT ": speed %g, expected %g, dx %g, expected %g\n", i, simulator.speed, speed,
+                    accelerated.dx, steps[i].event.dx * factor);
+            failures++;
+        }
+    }
+
+    // A reset starts over with the first event interval
+    accel_simulator_reset(&simulator);
+    SimulatorEvent accelerated;
+    accel_simulator_filter(&simulator, &(SimulatorEvent){T0 + 2009500, 0.7, 0}, &accelerated);
+    if (fabs(simulator.speed - 0.1) > 1e-12)
+    {
+        fprintf(stderr, "after reset: speed %g, expected 0.1\n", simulator.speed);
+        failures++;
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
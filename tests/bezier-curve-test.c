@@ -0,0 +1,134 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Checks the batch Bezier evaluation, and the lookup table behind the scalar
+// path, against a bisection solve of x(t) = x over a grid of handle positions.
+
+#include "plot-widget.h"
+#include "bezier-curve.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GRID_STEPS 10
+#define N_X_VALUES 129
+// Where x'(t) vanishes the root is triple and double precision only pins t
+// down to about cbrt(2^-52), no solver can do better than a few 1e-6 there
+#define BATCH_TOLERANCE 5e-6
+// The documented bound of the lookup table
+#define LUT_TOLERANCE 1e-4
+
+static double reference_y_value(const BezierCurve *curve, double x)
+{
+    // The curve goes through both corners. Bisecting for them would stop
+    // short where x(t) flattens out against the edge.
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 1;
+    double lo = 0, hi = 1;
+    for (int i = 0; i < 64; i++)
+    {
+        double mid = (lo + hi) / 2;
+        if (bezier_interpolate(mid, 0.0, curve->p1.x, curve->p2.x, 1.0) < x)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return bezier_interpolate((lo + hi) / 2, 0.0, curve->p1.y, curve->p2.y, 1.0);
+}
+
+typedef struct
+{
+    double batch_error;
+    double lut_error;
+    Point batch_p1, batch_p2;
+    double batch_x;
+} Errors;
+
+static void check_handles(BezierCurve *curve, Point p1, Point p2, Errors *errors)
+{
+    static double x_values[N_X_VALUES], y_values[N_X_VALUES];
+    curve->p1 = p1;
+    curve->p2 = p2;
+    bezier_update_lut(curve);
+    // Both ends of the range and a little past them
+    for (int i = 0; i < N_X_VALUES; i++)
+        x_values[i] = i / (double)(N_X_VALUES - 1);
+    x_values[1] = -0.5;
+    x_values[N_X_VALUES - 2] = 1.5;
+    bezier_evaluate_batch(curve, x_values, y_values, N_X_VALUES);
+    for (int i = 0; i < N_X_VALUES; i++)
+    {
+        double reference = reference_y_value(curve, x_values[i]);
+        double error = fabs(y_values[i] - reference);
+        if (!(error <= errors->batch_error))
+        {
+            errors->batch_error = error;
+            errors->batch_p1 = p1;
+            errors->batch_p2 = p2;
+            errors->batch_x = x_values[i];
+        }
+        errors->lut_error = fmax(errors->lut_error, fabs(bezier_evaluate_lut(curve, x_values[i]) - reference));
+    }
+}
+
+int main(void)
+{
+    BezierCurve *curve = (BezierCurve *)bezier_curve_new();
+    Errors errors = {0};
+
+    for (int i = 0; i <= GRID_STEPS; i++)
+        for (int j = 0; j <= GRID_STEPS; j++)
+            for (int k = 0; k <= GRID_STEPS; k++)
+                for (int l = 0; l <= GRID_STEPS; l++)
+                    check_handles(curve, (Point){i / (double)GRID_STEPS, j / (double)GRID_STEPS},
+                                  (Point){k / (double)GRID_STEPS, l / (double)GRID_STEPS}, &errors);
+
+    // The cubic term of x(t) cancels for p2.x = p1.x + 1/3, probe both sides of
+    // it and of the switch to the quadratic solve
+    static const double offsets[] = {0, 1e-12, -1e-12, 1e-9, -1e-9, 1e-7, -1e-7, 3.3e-6, -3.3e-6,
+                                     3.2e-4, -3.2e-4, 3.4e-4, -3.4e-4, 1e-2, -1e-2};
+    for (int i = 0; i <= 2 * GRID_STEPS; i++)
+    {
+        double p1_x = i / (double)(2 * GRID_STEPS) * 2 / 3;
+        for (gsize k = 0; k < G_N_ELEMENTS(offsets); k++)
+        {
+            double p2_x = p1_x + 1.0 / 3 + offsets[k];
+            if (p2_x < 0 || p2_x > 1)
+                continue;
+            for (int j = 0; j <= GRID_STEPS; j++)
+            {
+                double y = j / (double)GRID_STEPS;
+                check_handles(curve, (Point){p1_x, y}, (Point){p2_x, 1 - y}, &errors);
+                check_handles(curve, (Point){p1_x, y}, (Point){p2_x, y}, &errors);
+            }
+        }
+    }
+
+    printf("batch max error %.3g at p1 (%g, %g) p2 (%g, %g) x %g, lookup table max error %.3g\n",
+           errors.batch_error, UNPACK(errors.batch_p1), UNPACK(errors.batch_p2), errors.batch_x, errors.lut_error);
+    g_free(curve);
+    if (!(errors.batch_error <= BATCH_TOLERANCE) || !(errors.lut_error <= LUT_TOLERANCE))
+    {
+        fprintf(stderr, "error above tolerance (batch %g, lookup table %g)\n", BATCH_TOLERANCE, LUT_TOLERANCE);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
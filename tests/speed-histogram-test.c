@@ -0,0 +1,85 @@
+/* Copyright 2025 Yinon Burgansky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Checks that every speed is counted in the bin whose edges contain it, over
+// the whole range and past both ends of it.
+
+#include "speed-histogram.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+static void check(gboolean condition, const char *what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static guint64 count_bins(const SpeedHistogram *histogram)
+{
+    guint64 count = 0;
+    for (int i = 0; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+        count += histogram->bins[i];
+    return count;
+}
+
+int main(void)
+{
+    SpeedHistogram histogram;
+    speed_histogram_init(&histogram);
+
+    gboolean monotone = speed_histogram_get_bin_start(0) == 0;
+    for (int i = 0; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+        monotone = monotone && speed_histogram_get_bin_start(i) < speed_histogram_get_bin_end(i) &&
+                   (i == 0 || speed_histogram_get_bin_start(i) == speed_histogram_get_bin_end(i - 1));
+    check(monotone, "bin edges are increasing and contiguous");
+    check(speed_histogram_get_bin_start(1) == SPEED_HISTOGRAM_MIN_SPEED, "first log bin starts at the min speed");
+    check(isinf(speed_histogram_get_bin_end(SPEED_HISTOGRAM_BIN_COUNT - 1)), "last bin is open ended");
+
+    // Speeds spread log-uniformly past both ends, plus every edge itself
+    gboolean placed = TRUE;
+    for (int i = 0; i <= 100000; i++)
+    {
+        double speed = SPEED_HISTOGRAM_MIN_SPEED / 10 * pow(1e7, i / 100000.0);
+        int bin = speed_histogram_get_bin(speed);
+        placed = placed && speed_histogram_get_bin_start(bin) <= speed && speed < speed_histogram_get_bin_end(bin);
+        speed_histogram_add(&histogram, speed);
+    }
+    for (int i = 1; i < SPEED_HISTOGRAM_BIN_COUNT; i++)
+        placed = placed && speed_histogram_get_bin(speed_histogram_get_bin_start(i)) == i;
+    check(placed, "speeds land in the bin containing them");
+
+    check(speed_histogram_get_bin(0) == 0, "zero lands in the first bin");
+    check(speed_histogram_get_bin(SPEED_HISTOGRAM_MIN_SPEED / 2) == 0, "slow speeds land in the first bin");
+    check(speed_histogram_get_bin(SPEED_HISTOGRAM_MAX_SPEED * 100) == SPEED_HISTOGRAM_BIN_COUNT - 1,
+          "fast speeds land in the last bin");
+    check(histogram.total == 100001 && count_bins(&histogram) == histogram.total, "every sample is counted");
+
+    guint serial = histogram.serial;
+    speed_histogram_add(&histogram, NAN);
+    speed_histogram_add(&histogram, -1);
+    check(histogram.total == 100001 && histogram.serial == serial, "invalid speeds are ignored");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}